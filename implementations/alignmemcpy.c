@@ -0,0 +1,62 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+#include "copy.h"
+
+/*
+	Misaligned stores that cross a cache line are split in two,
+	misaligned loads are much cheaper.
+	Copy the first line unaligned, then move dst up to the next
+	line boundary so every store in the main loop stays within one line.
+	src keeps whatever alignment it had
+*/
+void *alignmemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	/* Up to 2 lines, too short for a prologue to pay off */
+	if (unlikely(size <= 2 * LINE)) {
+		copy_short(dst, src, size);
+		return dest_;
+	}
+
+	/* Prologue, skip is 1 - 64 bytes and overlaps the main loop */
+	const size_t skip = LINE - ((uintptr_t)dst % LINE);
+	copy64(dst, src);
+
+	dst  += skip;
+	src  += skip;
+	size -= skip;
+
+	/* Aligned stores, the last partial line is left for the epilogue */
+	__m128i *dst_v = __builtin_assume_aligned((__m128i *)dst, LINE);
+	while (size > LINE) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)src + 0),
+			      b = _mm_loadu_si128((const __m128i *)src + 1),
+			      c = _mm_loadu_si128((const __m128i *)src + 2),
+			      d = _mm_loadu_si128((const __m128i *)src + 3);
+		_mm_store_si128(dst_v + 0, a);
+		_mm_store_si128(dst_v + 1, b);
+		_mm_store_si128(dst_v + 2, c);
+		_mm_store_si128(dst_v + 3, d);
+
+		dst_v += 4;
+		src   += LINE;
+		size  -= LINE;
+	}
+
+	/* Epilogue, last line copied from the end, overlaps the loop */
+	copy64((char *)dst_v + size - LINE, src + size - LINE);
+
+	return dest_;
+}
+
+KERNEL_DESC(alignmemcpy, CPU_SSE2, 1, 0, 0);
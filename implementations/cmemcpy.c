@@ -1,5 +1,7 @@
 #include <stddef.h>
 
+#include "../tests/memcpy.h"
+
 void *cmemcpy(
 	      void *restrict const dest_,
 	const void *restrict const src_,
@@ -18,3 +20,5 @@ void *cmemcpy(
 
 	return dest_;
 }
+
+KERNEL_DESC(cmemcpy, 0, 1, 0, 0);
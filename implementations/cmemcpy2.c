@@ -1,5 +1,7 @@
 #include <stddef.h>
 
+#include "../tests/memcpy.h"
+
 void *cmemcpy2(
 	      void *restrict const dest_, 
 	const void *restrict const src_,
@@ -31,3 +33,5 @@ void *cmemcpy2(
 
 	return dest_;
 }
+
+KERNEL_DESC(cmemcpy2, 0, 1, 0, 0);
@@ -0,0 +1,57 @@
+#include <stddef.h>
+
+#include "../tests/memcpy.h"
+
+/*
+	cmemcpy2 without the remainder loop
+	The last word is copied from size - 8 and overlaps the loop,
+	shorter copies use the same trick with 4 and 2 byte words
+*/
+void *cmemcpy2_ovl(
+	      void *restrict const dest_, 
+	const void *restrict const src_,
+	size_t                     size) {
+
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	const size_t divisor = sizeof(long long int);
+
+	if (size < divisor) {
+		if (size >= sizeof(int)) {
+			const int head = *(const int *)src,
+				  tail = *(const int *)(src + size - sizeof(int));
+			*(int *)dst                        = head;
+			*(int *)(dst + size - sizeof(int)) = tail;
+
+		} else if (size >= sizeof(short)) {
+			const short head = *(const short *)src,
+				    tail = *(const short *)(src + size - sizeof(short));
+			*(short *)dst                          = head;
+			*(short *)(dst + size - sizeof(short)) = tail;
+
+		} else if (size) {
+			*dst = *src;
+		}
+
+		return dest_;
+	}
+
+	const size_t numberofints = size/divisor;
+
+	/* Copy 64 bit chunks */
+	      long long int * dst_u64 = (      long long int *)dst;
+	const long long int * src_u64 = (const long long int *)src;
+	for (size_t i = 0; i < numberofints; i++) {
+		*dst_u64 = *src_u64;
+		++dst_u64;
+		++src_u64;
+	}
+
+	/* Copy last 64 bits, overlapping if size isn't a multiple of 8 */
+	*(long long int *)(dst + size - divisor) = *(const long long int *)(src + size - divisor);
+
+	return dest_;
+}
+
+KERNEL_DESC(cmemcpy2_ovl, 0, 1, 0, 0);
@@ -4,6 +4,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "../tests/memcpy.h"
+
 /* 
 	inline at the end is a hint for the compiler
 	to generate the fastest possible call to a function,
@@ -104,4 +106,4 @@ void *cmemcpy4(
 	return dest_;
 }
 
-
+KERNEL_DESC(cmemcpy4, 0, 1, 0, 0);
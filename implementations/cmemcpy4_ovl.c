@@ -0,0 +1,130 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../tests/memcpy.h"
+
+/* 
+	inline at the end is a hint for the compiler
+	to generate the fastest possible call to a function,
+	usually it means inlining
+*/
+#define INLINE   __attribute__((always_inline)) inline
+#define NOINLINE __attribute__((noinline, noclone))
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/*
+	Less than 8 bytes
+	Two words from both ends that overlap in the middle,
+	both loads happen before the stores
+*/
+INLINE void smol_short4(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size)
+{
+	if (size >= sizeof(int)) {
+		const int head = *(const int *)src,
+			  tail = *(const int *)(src + size - sizeof(int));
+		*(int *)dst                        = head;
+		*(int *)(dst + size - sizeof(int)) = tail;
+
+	} else if (size >= sizeof(short)) {
+		const short head = *(const short *)src,
+			    tail = *(const short *)(src + size - sizeof(short));
+		*(short *)dst                          = head;
+		*(short *)(dst + size - sizeof(short)) = tail;
+
+	} else if (size) {
+		*dst = *src;
+	}
+}
+
+// Basic memcpy unaligned, last word overlaps instead of a remainder loop
+INLINE void *smol_unal4_ovl(
+	      void *restrict const dest_, 
+	const void *restrict const src_,
+	size_t                     size) 
+{
+	const size_t divisor      = sizeof(long long int);
+	const size_t numberofints = size/divisor;
+
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	if (unlikely(size < divisor)) {
+		smol_short4(dst, src, size);
+		return dest_;
+	}
+
+	/* Copy 64 bit chunks */
+	      long long int * dst_u64 = (      long long int *)dest_;
+	const long long int * src_u64 = (const long long int *)src_;
+	for (size_t i = 0; i < numberofints; i++) {
+		*dst_u64 = *src_u64;
+		++dst_u64;
+		++src_u64;
+	}
+
+	/* Copy last 64 bits, overlapping if size isn't a multiple of 8 */
+	*(long long int *)(dst + size - divisor) = *(const long long int *)(src + size - divisor);
+
+	return dest_;
+}
+
+INLINE void *smol_al4_ovl(
+	      void *restrict const dest_, 
+	const void *restrict const src_,
+	size_t                     size) 
+{
+	const size_t divisor      = sizeof(long long int);
+	const size_t numberofints = size/divisor;
+
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	if (unlikely(size < divisor)) {
+		smol_short4(dst, src, size);
+		return dest_;
+	}
+
+	/* Copy 64 bit chunks */
+	      long long int * dst_u64 = __builtin_assume_aligned((	long long int *)dest_, 8);
+	const long long int * src_u64 = __builtin_assume_aligned((const long long int *)src_,  8);
+
+	for (size_t i = 0; i < numberofints; i++) {
+		*dst_u64 = *src_u64;
+		++dst_u64;
+		++src_u64;
+	}
+
+	/* Last word is unaligned unless size is a multiple of 8 */
+	*(long long int *)(dst + size - divisor) = *(const long long int *)(src + size - divisor);
+
+	return dest_;
+}
+
+/*
+	Pick best memcpy strategy
+*/
+void *cmemcpy4_ovl(
+	      void *restrict const dest_, 
+	const void *restrict const src_,
+	size_t                     size) 
+{
+	if (likely(
+	   ((uintptr_t)src_) % 8 == 0 
+	   && 
+	   ((uintptr_t)dest_) % 8 == 0)
+	) {
+		smol_al4_ovl(dest_, src_, size);
+
+	} else {
+		smol_unal4_ovl(dest_, src_, size);
+	}
+
+	return dest_;
+}
+
+KERNEL_DESC(cmemcpy4_ovl, 0, 1, 0, 0);
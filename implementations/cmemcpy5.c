@@ -0,0 +1,189 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+/*
+	inline at the end is a hint for the compiler
+	to generate the fastest possible call to a function,
+	usually it means inlining
+*/
+#define INLINE   __attribute__((always_inline)) inline
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/*
+	From here on rep movsb, it has the lowest startup cost
+	relative to size with ERMSB. Works without it, just slower
+*/
+#ifndef BULK_THRESHOLD
+#define BULK_THRESHOLD 4096
+#endif
+
+/*
+	Unaligned loads and stores that don't break strict aliasing,
+	gcc turns each of them into a single mov
+*/
+INLINE uint64_t load64(const char *src) {
+	uint64_t v;
+	__builtin_memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+INLINE void store64(char *dst, uint64_t v) {
+	__builtin_memcpy(dst, &v, sizeof(v));
+}
+
+INLINE uint32_t load32(const char *src) {
+	uint32_t v;
+	__builtin_memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+INLINE void store32(char *dst, uint32_t v) {
+	__builtin_memcpy(dst, &v, sizeof(v));
+}
+
+INLINE uint16_t load16(const char *src) {
+	uint16_t v;
+	__builtin_memcpy(&v, src, sizeof(v));
+	return v;
+}
+
+INLINE void store16(char *dst, uint16_t v) {
+	__builtin_memcpy(dst, &v, sizeof(v));
+}
+
+/*
+	0 - 16 bytes
+	Two loads from both ends that overlap in the middle,
+	loads happen before stores so the overlap doesn't matter
+	e.g. 11 bytes: [0, 8) and [3, 11)
+*/
+INLINE void copy_0_16(char *dst, const char *src, size_t size) {
+
+	if (size >= 8) {
+		const uint64_t head = load64(src),
+			       tail = load64(src + size - 8);
+		store64(dst,            head);
+		store64(dst + size - 8, tail);
+
+	} else if (size >= 4) {
+		const uint32_t head = load32(src),
+			       tail = load32(src + size - 4);
+		store32(dst,            head);
+		store32(dst + size - 4, tail);
+
+	} else if (size >= 2) {
+		const uint16_t head = load16(src),
+			       tail = load16(src + size - 2);
+		store16(dst,            head);
+		store16(dst + size - 2, tail);
+
+	} else if (size) {
+		*dst = *src;
+	}
+}
+
+// 17 - 32 bytes, same trick with xmm
+INLINE void copy_17_32(char *dst, const char *src, size_t size) {
+
+	const __m128i head = _mm_loadu_si128((const __m128i *)src),
+		      tail = _mm_loadu_si128((const __m128i *)(src + size - 16));
+	_mm_storeu_si128((__m128i *)dst,                 head);
+	_mm_storeu_si128((__m128i *)(dst + size - 16),   tail);
+}
+
+// 33 - 64 bytes, two from the front and two from the back
+INLINE void copy_33_64(char *dst, const char *src, size_t size) {
+
+	const __m128i a = _mm_loadu_si128((const __m128i *)src),
+		      b = _mm_loadu_si128((const __m128i *)(src + 16)),
+		      c = _mm_loadu_si128((const __m128i *)(src + size - 32)),
+		      d = _mm_loadu_si128((const __m128i *)(src + size - 16));
+	_mm_storeu_si128((__m128i *)dst,                 a);
+	_mm_storeu_si128((__m128i *)(dst + 16),          b);
+	_mm_storeu_si128((__m128i *)(dst + size - 32),   c);
+	_mm_storeu_si128((__m128i *)(dst + size - 16),   d);
+}
+
+/*
+	65 - BULK_THRESHOLD bytes
+	64 bytes per iteration, 4 independent loads in flight,
+	the last 64 bytes are copied from the end and overlap the loop
+*/
+INLINE void copy_medium(char *dst, const char *src, size_t size) {
+
+	const __m128i a = _mm_loadu_si128((const __m128i *)(src + size - 64)),
+		      b = _mm_loadu_si128((const __m128i *)(src + size - 48)),
+		      c = _mm_loadu_si128((const __m128i *)(src + size - 32)),
+		      d = _mm_loadu_si128((const __m128i *)(src + size - 16));
+
+	char *dst_end = dst + size - 64;
+
+	while (dst < dst_end) {
+		const __m128i x0 = _mm_loadu_si128((const __m128i *)src + 0),
+			      x1 = _mm_loadu_si128((const __m128i *)src + 1),
+			      x2 = _mm_loadu_si128((const __m128i *)src + 2),
+			      x3 = _mm_loadu_si128((const __m128i *)src + 3);
+		_mm_storeu_si128((__m128i *)dst + 0, x0);
+		_mm_storeu_si128((__m128i *)dst + 1, x1);
+		_mm_storeu_si128((__m128i *)dst + 2, x2);
+		_mm_storeu_si128((__m128i *)dst + 3, x3);
+
+		dst += 64;
+		src += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)(dst_end) + 0, a);
+	_mm_storeu_si128((__m128i *)(dst_end) + 1, b);
+	_mm_storeu_si128((__m128i *)(dst_end) + 2, c);
+	_mm_storeu_si128((__m128i *)(dst_end) + 3, d);
+}
+
+// BULK_THRESHOLD and up
+INLINE void copy_bulk(char *dst, const char *src, size_t size) {
+
+	asm volatile(
+		"rep movsb"
+		: "+D" (dst), "+S" (src), "+c" (size) // in and out
+		:				      // in
+		: "memory"			      // clobbers
+	);
+}
+
+/*
+	Pick strategy by size class instead of alignment
+	Small sizes come first, most copies are short
+*/
+void *cmemcpy5(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	if (likely(size <= 16)) {
+		copy_0_16(dst, src, size);
+
+	} else if (size <= 32) {
+		copy_17_32(dst, src, size);
+
+	} else if (size <= 64) {
+		copy_33_64(dst, src, size);
+
+	} else if (size < BULK_THRESHOLD) {
+		copy_medium(dst, src, size);
+
+	} else {
+		copy_bulk(dst, src, size);
+	}
+
+	return dest_;
+}
+
+KERNEL_DESC(cmemcpy5, CPU_SSE2, 1, 0, 0);
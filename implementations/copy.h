@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+/*
+	SSE2 copy helpers shared by alignmemcpy, pfmemcpy, genmemcpy.h and pool.h
+	Not a kernel. SSE2 is part of x86-64, so they inline into
+	any caller, whatever its -march or target attribute
+*/
+
+/*
+	inline at the end is a hint for the compiler
+	to generate the fastest possible call to a function,
+	usually it means inlining
+*/
+#define INLINE   __attribute__((always_inline)) inline
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define LINE 64
+
+INLINE void copy16(char *dst, const char *src) {
+	_mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+}
+
+INLINE void copy64(char *dst, const char *src) {
+	const __m128i a = _mm_loadu_si128((const __m128i *)src + 0),
+		      b = _mm_loadu_si128((const __m128i *)src + 1),
+		      c = _mm_loadu_si128((const __m128i *)src + 2),
+		      d = _mm_loadu_si128((const __m128i *)src + 3);
+	_mm_storeu_si128((__m128i *)dst + 0, a);
+	_mm_storeu_si128((__m128i *)dst + 1, b);
+	_mm_storeu_si128((__m128i *)dst + 2, c);
+	_mm_storeu_si128((__m128i *)dst + 3, d);
+}
+
+/*
+	Up to 2 lines, copies from both ends overlap in the middle
+	Callers that stop at one line never take the first branch
+*/
+INLINE void copy_short(char *dst, const char *src, size_t size) {
+
+	if (size > LINE) {
+		copy64(dst,               src);
+		copy64(dst + size - LINE, src + size - LINE);
+
+	} else if (size > 32) {
+		copy16(dst,             src);
+		copy16(dst + 16,        src + 16);
+		copy16(dst + size - 32, src + size - 32);
+		copy16(dst + size - 16, src + size - 16);
+
+	} else if (size >= 16) {
+		copy16(dst,             src);
+		copy16(dst + size - 16, src + size - 16);
+
+	} else if (size >= 8) {
+		const long long int head = *(const long long int *)src,
+				    tail = *(const long long int *)(src + size - 8);
+		*(long long int *)dst              = head;
+		*(long long int *)(dst + size - 8) = tail;
+
+	} else if (size >= 4) {
+		const int head = *(const int *)src,
+			  tail = *(const int *)(src + size - 4);
+		*(int *)dst              = head;
+		*(int *)(dst + size - 4) = tail;
+
+	} else if (size >= 2) {
+		const short head = *(const short *)src,
+			    tail = *(const short *)(src + size - 2);
+		*(short *)dst              = head;
+		*(short *)(dst + size - 2) = tail;
+
+	} else if (size) {
+		*dst = *src;
+	}
+}
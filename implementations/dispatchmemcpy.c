@@ -0,0 +1,78 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../tests/cpu_features.h"
+#include "../tests/memcpy.h"
+
+/*
+	One entry point for every host
+	dispatchmemcpy.so is linked together with the kernels below
+	and built for plain x86-64, each kernel enables its own ISA.
+	The dynamic linker calls resolve_memcpy() once, when it relocates
+	dispatchmemcpy, and binds the symbol to whatever it returned,
+	so calls don't pay for the dispatch
+*/
+
+// Hidden, so the resolver takes their addresses without going through the GOT,
+// which might not be relocated yet when the resolver runs
+#define HIDDEN __attribute__((visibility("hidden")))
+
+HIDDEN void *avx512memcpy_unal(void *restrict const, const void *restrict const, size_t);
+HIDDEN void *avx2memcpy_unal  (void *restrict const, const void *restrict const, size_t);
+HIDDEN void *sse2memcpy_unal  (void *restrict const, const void *restrict const, size_t);
+HIDDEN void *ermsmemcpy       (void *restrict const, const void *restrict const, size_t);
+HIDDEN void *cmemcpy2         (void *restrict const, const void *restrict const, size_t);
+
+/*
+	Widest vector first, then rep movsb, then scalar
+	Compare with print_winners() in tests/tests before changing the order
+*/
+static memcpy_t pick_memcpy(const char **name) {
+
+	const uint32_t features = detect_cpu_features();
+
+	if (features & CPU_AVX512F) {
+		*name = "avx512memcpy_unal";
+		return avx512memcpy_unal;
+	}
+
+	if (features & CPU_AVX2) {
+		*name = "avx2memcpy_unal";
+		return avx2memcpy_unal;
+	}
+
+	if ((features & CPU_ERMS) && (features & CPU_SSE2)) {
+		*name = "ermsmemcpy";
+		return ermsmemcpy;
+	}
+
+	if (features & CPU_SSE2) {
+		*name = "sse2memcpy_unal";
+		return sse2memcpy_unal;
+	}
+
+	*name = "cmemcpy2";
+	return cmemcpy2;
+}
+
+static memcpy_t resolve_memcpy(void) {
+
+	const char *name;
+	return pick_memcpy(&name);
+}
+
+void *dispatchmemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size) __attribute__((ifunc("resolve_memcpy")));
+
+// Name of the kernel dispatchmemcpy resolves to on this host
+const char *dispatchmemcpy_name(void) {
+
+	const char *name;
+	pick_memcpy(&name);
+
+	return name;
+}
+
+KERNEL_DESC(dispatchmemcpy, 0, 1, 0, 0);
@@ -0,0 +1,100 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+/*
+	inline at the end is a hint for the compiler
+	to generate the fastest possible call to a function,
+	usually it means inlining
+*/
+#define INLINE   __attribute__((always_inline)) inline
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/*
+	Copies of at least this many bytes go through rep movsb,
+	set it with make ERMS_THRESHOLD=... or ermsmemcpy_set_threshold()
+	Without FSRM rep movsb has a startup cost of a few dozen cycles,
+	with FSRM it can be set much lower
+*/
+#ifndef ERMS_THRESHOLD
+#define ERMS_THRESHOLD 2048
+#endif
+
+static size_t erms_threshold = ERMS_THRESHOLD;
+
+void ermsmemcpy_set_threshold(size_t threshold) {
+	erms_threshold = threshold;
+}
+
+size_t ermsmemcpy_get_threshold(void) {
+	return erms_threshold;
+}
+
+INLINE void copy_rep_movsb(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size)
+{
+	asm volatile(
+		"rep movsb"
+		: "+D" (dst), "+S" (src), "+c" (size) // in and out
+		:				      // in
+		: "memory"			      // clobbers
+	);
+}
+
+// 16 bytes per iteration, then 64 bit chunks and bytes
+INLINE void copy_vec(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size)
+{
+	const size_t numberofvecs = size / sizeof(__m128i);
+	      size_t remainder    = size % sizeof(__m128i);
+
+	for (size_t i = 0; i < numberofvecs; i++) {
+		_mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+		dst += sizeof(__m128i);
+		src += sizeof(__m128i);
+	}
+
+	if (remainder >= sizeof(long long int)) {
+		*(long long int *)dst = *(const long long int *)src;
+		dst       += sizeof(long long int);
+		src       += sizeof(long long int);
+		remainder -= sizeof(long long int);
+	}
+
+	while (remainder) {
+		*dst = *src;
+		++dst;
+		++src;
+
+		--remainder;
+	}
+}
+
+/*
+	Pick vector loop or rep movsb by size
+*/
+void *ermsmemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	if (likely(size < erms_threshold)) {
+		copy_vec((char *)dest_, (const char *)src_, size);
+
+	} else {
+		copy_rep_movsb((char *)dest_, (const char *)src_, size);
+	}
+
+	return dest_;
+}
+
+KERNEL_DESC(ermsmemcpy, CPU_ERMS | CPU_SSE2, 1, 0, 0);
@@ -0,0 +1,136 @@
+/*
+	Template for the genmemcpy_u<UNROLL>_w<WIDTH>_<t|nt> family
+	Not a header, the Makefile compiles it once per variant with -x c:
+
+	GEN_NAME	exported symbol, same as the .so name
+	GEN_UNROLL	vectors loaded before any of them is stored, 1 2 4 8
+	GEN_WIDTH	bytes per load/store, 8 16 32 64
+	GEN_NT		1 for non-temporal stores, 0 for regular ones
+*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+#include "copy.h"
+
+#if !defined(GEN_NAME) || !defined(GEN_UNROLL) || !defined(GEN_WIDTH) || !defined(GEN_NT)
+#error "genmemcpy.h needs GEN_NAME, GEN_UNROLL, GEN_WIDTH and GEN_NT"
+#endif
+
+#if GEN_WIDTH == 8
+	// movnti is SSE2
+	#define TARGET		__attribute__((target("sse2")))
+	#define FEATURES	CPU_SSE2
+	typedef long long int	vec_t;
+	#define LOAD(p)		(*(const vec_t *)(p))
+	#define STORE(p, v)	(*(vec_t *)(p) = (v))
+	#define STREAM(p, v)	_mm_stream_si64((long long int *)(p), (v))
+
+#elif GEN_WIDTH == 16
+	#define TARGET		__attribute__((target("sse2")))
+	#define FEATURES	CPU_SSE2
+	typedef __m128i		vec_t;
+	#define LOAD(p)		_mm_loadu_si128((const __m128i *)(p))
+	#define STORE(p, v)	_mm_storeu_si128((__m128i *)(p), (v))
+	#define STREAM(p, v)	_mm_stream_si128((__m128i *)(p), (v))
+
+#elif GEN_WIDTH == 32
+	#define TARGET		__attribute__((target("avx2")))
+	#define FEATURES	CPU_AVX2
+	typedef __m256i		vec_t;
+	#define LOAD(p)		_mm256_loadu_si256((const __m256i *)(p))
+	#define STORE(p, v)	_mm256_storeu_si256((__m256i *)(p), (v))
+	#define STREAM(p, v)	_mm256_stream_si256((__m256i *)(p), (v))
+
+#elif GEN_WIDTH == 64
+	#define TARGET		__attribute__((target("avx512f")))
+	#define FEATURES	CPU_AVX512F
+	typedef __m512i		vec_t;
+	#define LOAD(p)		_mm512_loadu_si512((const void *)(p))
+	#define STORE(p, v)	_mm512_storeu_si512((void *)(p), (v))
+	#define STREAM(p, v)	_mm512_stream_si512((void *)(p), (v))
+
+#else
+#error "GEN_WIDTH has to be 8, 16, 32 or 64"
+#endif
+
+#define BLOCK (GEN_WIDTH * GEN_UNROLL)
+
+/* GEN_UNROLL loads in flight, then GEN_UNROLL stores */
+#define COPY_BLOCK(dst, src, store)				\
+	do {							\
+		vec_t v[GEN_UNROLL];				\
+								\
+		_Pragma("GCC unroll 8")				\
+		for (int k = 0; k < GEN_UNROLL; k++)		\
+			v[k] = LOAD((src) + k * GEN_WIDTH);	\
+								\
+		_Pragma("GCC unroll 8")				\
+		for (int k = 0; k < GEN_UNROLL; k++)		\
+			store((dst) + k * GEN_WIDTH, v[k]);	\
+	} while (0)
+
+_Static_assert(sizeof(vec_t) == GEN_WIDTH, "vec_t doesn't match GEN_WIDTH");
+
+TARGET void *GEN_NAME(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+#if GEN_NT
+	/*
+		Vector stream stores need dst aligned to GEN_WIDTH,
+		copy one unaligned vector and skip up to the next boundary.
+		Shorter copies only use regular stores
+	*/
+	if (likely(size >= 2 * BLOCK)) {
+		const size_t skip = GEN_WIDTH - ((uintptr_t)dst % GEN_WIDTH);
+		STORE(dst, LOAD(src));
+
+		dst  += skip;
+		src  += skip;
+		size -= skip;
+
+		while (size >= BLOCK) {
+			COPY_BLOCK(dst, src, STREAM);
+
+			dst  += BLOCK;
+			src  += BLOCK;
+			size -= BLOCK;
+		}
+
+		// NT stores are weakly ordered, make them visible before returning
+		_mm_sfence();
+	}
+#endif
+
+	while (size >= BLOCK) {
+		COPY_BLOCK(dst, src, STORE);
+
+		dst  += BLOCK;
+		src  += BLOCK;
+		size -= BLOCK;
+	}
+
+	/* Less than GEN_UNROLL vectors left */
+	while (size >= GEN_WIDTH) {
+		STORE(dst, LOAD(src));
+
+		dst  += GEN_WIDTH;
+		src  += GEN_WIDTH;
+		size -= GEN_WIDTH;
+	}
+
+	/* Less than one vector, copy_short() overlaps from both ends */
+	copy_short(dst, src, size);
+
+	return dest_;
+}
+
+KERNEL_DESC(GEN_NAME, FEATURES, 1, 0, 0);
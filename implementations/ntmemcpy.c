@@ -0,0 +1,132 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+/*
+	inline at the end is a hint for the compiler
+	to generate the fastest possible call to a function,
+	usually it means inlining
+*/
+#define INLINE   __attribute__((always_inline)) inline
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+/*
+	Copies of at least this many bytes bypass the cache,
+	set it with make NT_THRESHOLD=... or ntmemcpy_set_threshold()
+	It should be somewhere around the LLC size of the target
+*/
+#ifndef NT_THRESHOLD
+#define NT_THRESHOLD (1 << 22)
+#endif
+
+static size_t nt_threshold = NT_THRESHOLD;
+
+void ntmemcpy_set_threshold(size_t threshold) {
+	nt_threshold = threshold;
+}
+
+size_t ntmemcpy_get_threshold(void) {
+	return nt_threshold;
+}
+
+// Regular stores, 16 bytes per iteration, then 64 bit chunks and bytes
+INLINE void copy_temporal(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size)
+{
+	const size_t numberofvecs = size / sizeof(__m128i);
+	      size_t remainder    = size % sizeof(__m128i);
+
+	for (size_t i = 0; i < numberofvecs; i++) {
+		_mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+		dst += sizeof(__m128i);
+		src += sizeof(__m128i);
+	}
+
+	if (remainder >= sizeof(long long int)) {
+		*(long long int *)dst = *(const long long int *)src;
+		dst       += sizeof(long long int);
+		src       += sizeof(long long int);
+		remainder -= sizeof(long long int);
+	}
+
+	while (remainder) {
+		*dst = *src;
+		++dst;
+		++src;
+
+		--remainder;
+	}
+}
+
+/*
+	movntdq goes through write combining buffers straight to memory,
+	so the destination doesn't evict the working set from LLC.
+	Writing full 64 byte lines lets each WC buffer flush as one burst
+*/
+INLINE void copy_nontemporal(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size)
+{
+	// Regular stores until dst sits on a cache line boundary
+	      size_t head = (64 - ((uintptr_t)dst % 64)) % 64;
+	if (head > size)
+		head = size;
+
+	copy_temporal(dst, src, head);
+
+	dst  += head;
+	src  += head;
+	size -= head;
+
+	const size_t numberoflines = size / 64;
+	const size_t remainder     = size % 64;
+
+	__m128i *dst_v = __builtin_assume_aligned((__m128i *)dst, 64);
+	for (size_t i = 0; i < numberoflines; i++) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)src + 0);
+		const __m128i b = _mm_loadu_si128((const __m128i *)src + 1);
+		const __m128i c = _mm_loadu_si128((const __m128i *)src + 2);
+		const __m128i d = _mm_loadu_si128((const __m128i *)src + 3);
+
+		_mm_stream_si128(dst_v + 0, a);
+		_mm_stream_si128(dst_v + 1, b);
+		_mm_stream_si128(dst_v + 2, c);
+		_mm_stream_si128(dst_v + 3, d);
+
+		dst_v += 4;
+		src   += 64;
+	}
+
+	copy_temporal((char *)dst_v, src, remainder);
+
+	// NT stores are weakly ordered, make them visible before returning
+	_mm_sfence();
+}
+
+/*
+	Pick regular or streaming stores by size
+*/
+void *ntmemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	if (unlikely(size >= nt_threshold)) {
+		copy_nontemporal((char *)dest_, (const char *)src_, size);
+
+	} else {
+		copy_temporal((char *)dest_, (const char *)src_, size);
+	}
+
+	return dest_;
+}
+
+KERNEL_DESC(ntmemcpy, CPU_SSE2, 1, 0, 0);
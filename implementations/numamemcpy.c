@@ -0,0 +1,107 @@
+#include "pool.h"
+
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "../tests/memcpy.h"
+
+/*
+	Same pool as parmemcpy, but only the threads running on the
+	NUMA node that holds dst take part, so every store is local
+	and only the loads may have to cross the interconnect
+*/
+
+/*
+	Copies of at least this many bytes are split across the pool,
+	set it with make PAR_THRESHOLD=... or numamemcpy_set_threshold()
+*/
+#ifndef PAR_THRESHOLD
+#define PAR_THRESHOLD (1 << 24)
+#endif
+
+/*
+	Threads used for one copy, the calling thread included if it's on
+	the right node, set it with make PAR_THREADS=... or numamemcpy_set_threads()
+	0 means every thread of the node
+*/
+#ifndef PAR_THREADS
+#define PAR_THREADS 0
+#endif
+
+static size_t par_threshold = PAR_THRESHOLD;
+static size_t par_threads   = PAR_THREADS;
+
+void numamemcpy_set_threshold(size_t threshold) {
+	par_threshold = threshold;
+}
+
+size_t numamemcpy_get_threshold(void) {
+	return par_threshold;
+}
+
+void numamemcpy_set_threads(size_t threads) {
+	par_threads = threads;
+}
+
+size_t numamemcpy_get_threads(void) {
+	return par_threads;
+}
+
+// Threads in the pool, the calling thread included, starts the pool if needed
+size_t numamemcpy_get_max_threads(void) {
+	return pool_size();
+}
+
+/*
+	Node of the page holding addr, faults it in if it isn't there yet
+	-1 without NUMA support in the kernel
+*/
+static long page_node(const void *addr) {
+
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0)
+		return -1;
+
+	return node;
+}
+
+void *numamemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	if (likely(size < par_threshold)) {
+		copy_range(dst, src, size);
+		return dest_;
+	}
+
+	const size_t max_threads = pool_size();
+
+	size_t threads = par_threads;
+	if (threads == 0 || threads > max_threads)
+		threads = max_threads;
+
+	// Unknown node, fall back to plain parmemcpy behaviour
+	const long node = page_node(dst);
+
+	unsigned int cpu = 0, caller_node = 0;
+	getcpu(&cpu, &caller_node);
+
+	const int with_caller = node < 0 || caller_node == (unsigned long)node;
+
+	int    use[POOL_MAX_THREADS];
+	size_t used = with_caller ? 1 : 0;
+	for (size_t i = 1; i < max_threads; i++) {
+		use[i] = used < threads && (node < 0 || pool.node[i] == (unsigned long)node);
+		used  += use[i];
+	}
+
+	pool_run(dst, src, size, use, with_caller);
+
+	return dest_;
+}
+
+KERNEL_DESC(numamemcpy, CPU_SSE2, 1, 0, 0);
@@ -0,0 +1,79 @@
+#include "pool.h"
+#include "../tests/memcpy.h"
+
+/*
+	Copies of at least this many bytes are split across the pool,
+	set it with make PAR_THRESHOLD=... or parmemcpy_set_threshold()
+	Waking the workers costs a few microseconds, below that
+	one core is already close to the bandwidth it can get
+*/
+#ifndef PAR_THRESHOLD
+#define PAR_THRESHOLD (1 << 24)
+#endif
+
+/*
+	Threads used for one copy, the calling thread included
+	set it with make PAR_THREADS=... or parmemcpy_set_threads()
+	0 means every thread in the pool
+*/
+#ifndef PAR_THREADS
+#define PAR_THREADS 0
+#endif
+
+static size_t par_threshold = PAR_THRESHOLD;
+static size_t par_threads   = PAR_THREADS;
+
+void parmemcpy_set_threshold(size_t threshold) {
+	par_threshold = threshold;
+}
+
+size_t parmemcpy_get_threshold(void) {
+	return par_threshold;
+}
+
+void parmemcpy_set_threads(size_t threads) {
+	par_threads = threads;
+}
+
+size_t parmemcpy_get_threads(void) {
+	return par_threads;
+}
+
+// Threads in the pool, the calling thread included, starts the pool if needed
+size_t parmemcpy_get_max_threads(void) {
+	return pool_size();
+}
+
+/*
+	The calling thread and the first threads - 1 workers,
+	wherever the buffers are
+*/
+void *parmemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	if (likely(size < par_threshold)) {
+		copy_range(dst, src, size);
+		return dest_;
+	}
+
+	const size_t max_threads = pool_size();
+
+	size_t threads = par_threads;
+	if (threads == 0 || threads > max_threads)
+		threads = max_threads;
+
+	int use[POOL_MAX_THREADS];
+	for (size_t i = 0; i < max_threads; i++)
+		use[i] = i < threads;
+
+	pool_run(dst, src, size, use, 1);
+
+	return dest_;
+}
+
+KERNEL_DESC(parmemcpy, CPU_SSE2, 1, 0, 0);
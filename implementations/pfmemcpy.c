@@ -0,0 +1,64 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+#include "copy.h"
+
+/*
+	How far ahead of the loads to prefetch, in bytes
+	set it with make PF_DISTANCE=... or pfmemcpy_set_distance()
+	Too short and the line isn't there yet, too long and it's
+	evicted again before use, the best value depends on memory latency
+*/
+#ifndef PF_DISTANCE
+#define PF_DISTANCE 512
+#endif
+
+static size_t pf_distance = PF_DISTANCE;
+
+void pfmemcpy_set_distance(size_t distance) {
+	pf_distance = distance;
+}
+
+size_t pfmemcpy_get_distance(void) {
+	return pf_distance;
+}
+
+/*
+	One prefetcht0 per line, pf_distance bytes ahead of the loads
+	Prefetches past the end of src don't fault, they are just wasted
+*/
+void *pfmemcpy(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      char *dst = (      char *)dest_;
+	const char *src = (const char *)src_;
+
+	if (unlikely(size <= LINE)) {
+		copy_short(dst, src, size);
+		return dest_;
+	}
+
+	const size_t distance = pf_distance;
+
+	/* Last line is copied from the end and overlaps the loop */
+	const size_t numberoflines = (size - 1) / LINE;
+	for (size_t i = 0; i < numberoflines; i++) {
+		_mm_prefetch(src + distance, _MM_HINT_T0);
+		copy64(dst, src);
+
+		dst += LINE;
+		src += LINE;
+	}
+
+	copy64((char *)dest_ + size - LINE, (const char *)src_ + size - LINE);
+
+	return dest_;
+}
+
+KERNEL_DESC(pfmemcpy, CPU_SSE2, 1, 0, 0);
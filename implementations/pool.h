@@ -0,0 +1,258 @@
+#pragma once
+#define _GNU_SOURCE 	// pthread_attr_setaffinity_np() and getcpu()
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "copy.h"
+
+/*
+	Worker pool shared by parmemcpy and numamemcpy
+	Not a kernel, every .so that includes it gets its own pool.
+	Needs libc, the Makefile builds them without -nostdlib and with -pthread
+*/
+
+// Slices start on a page boundary of dst, so no two threads store into one page
+#define PAGE 4096
+
+// Upper bound of the pool, the real size is the number of online cpus
+#define POOL_MAX_THREADS 64
+
+// Slot of a worker that sits out the current job
+#define POOL_IDLE SIZE_MAX
+
+typedef struct {
+	      char *dst;
+	const char *src;
+	size_t      size;
+	size_t      slice;
+} Job;
+
+/*
+	Workers sleep on wake until generation changes, copy the slice
+	in their slot and count pending down, the last one signals done.
+	Index 0 stands for the calling thread, it has no pthread of its own
+*/
+static struct {
+	pthread_once_t  once;
+	pthread_mutex_t call; // one copy at a time, the pool has a single Job
+	pthread_mutex_t lock;
+	pthread_cond_t  wake;
+	pthread_cond_t  done;
+
+	pthread_t       threads[POOL_MAX_THREADS];
+	unsigned int    node   [POOL_MAX_THREADS]; // NUMA node each worker runs on
+	size_t          slot   [POOL_MAX_THREADS]; // slice of the current job or POOL_IDLE
+	size_t          count;   // workers + the calling thread
+	size_t          started; // workers that filled in their node
+	size_t          pending; // workers still copying
+	uint64_t        generation;
+	int             stop;
+
+	Job             job;
+} pool = {
+	.once = PTHREAD_ONCE_INIT,
+	.call = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+// Single threaded copy, every thread runs it on its own slice
+static void copy_range(char *dst, const char *src, size_t size) {
+
+	if (unlikely(size <= LINE)) {
+		copy_short(dst, src, size);
+		return;
+	}
+
+	/* Last line is copied from the end and overlaps the loop */
+	const size_t numberoflines = (size - 1) / LINE;
+	for (size_t i = 0; i < numberoflines; i++) {
+		copy64(dst + i * LINE, src + i * LINE);
+	}
+
+	copy64(dst + size - LINE, src + size - LINE);
+}
+
+/*
+	Slice i of the job, slices past the end are empty
+	Boundaries are page aligned in dst, only the first one may start unaligned
+*/
+static void copy_slice(const Job *job, size_t i) {
+
+	const size_t head  = (PAGE - ((uintptr_t)job->dst % PAGE)) % PAGE;
+
+	size_t start = i ? head + i * job->slice : 0,
+	       end   = head + (i + 1) * job->slice;
+
+	if (start > job->size)
+		start = job->size;
+	if (end > job->size)
+		end = job->size;
+
+	copy_range(job->dst + start, job->src + start, end - start);
+}
+
+static void *worker(void *arg) {
+
+	const size_t id   = (size_t)arg;
+	uint64_t     seen = 0;
+
+	// Already on its own cpu, the affinity was set before it started
+	unsigned int cpu = 0, node = 0;
+	getcpu(&cpu, &node);
+
+	pthread_mutex_lock(&pool.lock);
+	pool.node[id] = node;
+	pool.started++;
+	pthread_cond_broadcast(&pool.done);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+		while (pool.generation == seen && !pool.stop)
+			pthread_cond_wait(&pool.wake, &pool.lock);
+
+		if (pool.stop) {
+			pthread_mutex_unlock(&pool.lock);
+			return NULL;
+		}
+
+		seen = pool.generation;
+		const size_t slot = pool.slot[id];
+		const Job    job  = pool.job;
+		pthread_mutex_unlock(&pool.lock);
+
+		if (slot == POOL_IDLE)
+			continue;
+
+		copy_slice(&job, slot);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.pending == 0)
+			pthread_cond_signal(&pool.done);
+		pthread_mutex_unlock(&pool.lock);
+	}
+}
+
+/*
+	One worker per online cpu, minus the one the first caller runs on.
+	Worker i is pinned to the i-th cpu after the caller's,
+	so with the benchmark pinned to the last cpu they fill 0, 1, 2...
+	Waits until every worker knows its node
+*/
+static void pool_start(void) {
+
+	const long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	unsigned int caller = 0, node = 0;
+	getcpu(&caller, &node);
+
+	size_t count = online > 0 ? (size_t)online : 1;
+	if (count > POOL_MAX_THREADS)
+		count = POOL_MAX_THREADS;
+
+	pool.node[0] = node;
+	pool.count   = 1;
+	for (size_t i = 1; i < count; i++) {
+
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET((caller + i) % (size_t)online, &cpu_set);
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+
+		const int failed = pthread_create(&pool.threads[i], &attr, worker, (void *)i) != 0;
+		pthread_attr_destroy(&attr);
+		if (failed)
+			break;
+
+		pool.count++;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.started < pool.count - 1)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+// Workers can't outlive the code they run, join them before dlclose() unmaps it
+__attribute__((destructor)) static void pool_stop(void) {
+
+	pthread_mutex_lock(&pool.lock);
+	pool.stop = 1;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (size_t i = 1; i < pool.count; i++)
+		pthread_join(pool.threads[i], NULL);
+}
+
+// Threads in the pool, the calling thread included, starts the pool if needed
+static size_t pool_size(void) {
+
+	pthread_once(&pool.once, pool_start);
+	return pool.count;
+}
+
+/*
+	Split the copy between the calling thread (if with_caller)
+	and every worker i with use[i] set, then wait for all of them.
+	use has pool_size() elements, use[0] is ignored
+*/
+static void pool_run(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size,
+	const int           *use,
+	int                  with_caller)
+{
+	pthread_mutex_lock(&pool.call);
+
+	size_t slices = with_caller ? 1 : 0;
+	for (size_t i = 1; i < pool.count; i++)
+		slices += use[i] != 0;
+
+	if (slices == 0) {
+		copy_range(dst, src, size);
+		pthread_mutex_unlock(&pool.call);
+		return;
+	}
+
+	// Whole pages per thread, the last slice takes the remainder
+	const size_t per_thread = (size / slices + PAGE - 1) / PAGE * PAGE;
+
+	/*
+		slot[] under pool.lock with job and generation, a worker still waking up
+		from the last call reads either all of the old ones or all of the new ones
+	*/
+	pthread_mutex_lock(&pool.lock);
+	size_t slot = with_caller ? 1 : 0;
+	for (size_t i = 1; i < pool.count; i++)
+		pool.slot[i] = use[i] ? slot++ : POOL_IDLE;
+
+	pool.job     = (Job){ dst, src, size, per_thread };
+	pool.pending = slices - (with_caller ? 1 : 0);
+	pool.generation++;
+	pthread_cond_broadcast(&pool.wake);
+
+	if (with_caller) {
+		pthread_mutex_unlock(&pool.lock);
+		copy_slice(&pool.job, 0);
+		pthread_mutex_lock(&pool.lock);
+	}
+
+	// The lock handoff also makes the workers' stores visible here
+	while (pool.pending)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	pthread_mutex_unlock(&pool.call);
+}
@@ -0,0 +1,29 @@
+#include <stddef.h>
+
+#include "../tests/memcpy.h"
+
+/*
+	Let the microcode do it
+	With ERMSB it moves whole cache lines once size is large enough,
+	with FSRM (Ice Lake and later) the startup cost for short copies is low too.
+	Check CPU_ERMS in Cpustat.features before trusting the numbers
+*/
+void *repmovsb(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	      void *dst = dest_;
+	const void *src = src_;
+
+	asm volatile(
+		"rep movsb"
+		: "+D" (dst), "+S" (src), "+c" (size) // in and out
+		:				      // in
+		: "memory"			      // clobbers
+	);
+
+	return dest_;
+}
+
+KERNEL_DESC(repmovsb, CPU_ERMS, 1, 0, 0);
@@ -0,0 +1,173 @@
+/*
+	Template for the sse2memcpy, avx2memcpy and avx512memcpy _al/_unal family
+	Not a header, the Makefile compiles it once per variant with -x c:
+
+	VEC_NAME	exported symbol, same as the .so name
+	VEC_WIDTH	bytes per load/store, 16 (sse2), 32 (avx2) or 64 (avx512f)
+	VEC_ALIGNED	1 for aligned loads and stores when both pointers allow it,
+			0 for unaligned ones over the whole buffer
+*/
+#include <stddef.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+
+#include "../tests/memcpy.h"
+
+#if !defined(VEC_NAME) || !defined(VEC_WIDTH) || !defined(VEC_ALIGNED)
+#error "vecmemcpy.h needs VEC_NAME, VEC_WIDTH and VEC_ALIGNED"
+#endif
+
+/*
+	inline at the end is a hint for the compiler
+	to generate the fastest possible call to a function,
+	usually it means inlining
+*/
+#define INLINE   __attribute__((always_inline)) inline
+
+/*
+	Enable the vector ISA only for this file's functions,
+	so it still builds with ARCH_RAPTORLAKE (-mno-avx)
+	Check Cpustat.features before calling it
+*/
+#if VEC_WIDTH == 16
+	#define TARGET		__attribute__((target("sse2")))
+	#define FEATURES	CPU_SSE2
+	typedef __m128i		vec_t;
+	#define LOADU(p)	_mm_loadu_si128(p)
+	#define STOREU(p, v)	_mm_storeu_si128((p), (v))
+	#define LOAD(p)		_mm_load_si128(p)
+	#define STORE(p, v)	_mm_store_si128((p), (v))
+
+#elif VEC_WIDTH == 32
+	#define TARGET		__attribute__((target("avx2")))
+	#define FEATURES	CPU_AVX2
+	typedef __m256i		vec_t;
+	#define LOADU(p)	_mm256_loadu_si256(p)
+	#define STOREU(p, v)	_mm256_storeu_si256((p), (v))
+	#define LOAD(p)		_mm256_load_si256(p)
+	#define STORE(p, v)	_mm256_store_si256((p), (v))
+
+#elif VEC_WIDTH == 64
+	#define TARGET		__attribute__((target("avx512f")))
+	#define FEATURES	CPU_AVX512F
+	typedef __m512i		vec_t;
+	#define LOADU(p)	_mm512_loadu_si512(p)
+	#define STOREU(p, v)	_mm512_storeu_si512((p), (v))
+	#define LOAD(p)		_mm512_load_si512(p)
+	#define STORE(p, v)	_mm512_store_si512((p), (v))
+
+#else
+#error "VEC_WIDTH has to be 16, 32 or 64"
+#endif
+
+_Static_assert(sizeof(vec_t) == VEC_WIDTH, "vec_t doesn't match VEC_WIDTH");
+
+// Less than one vector left, copy it in 64 bit chunks and then bytes
+TARGET INLINE void tail(
+	      char *restrict dst,
+	const char *restrict src,
+	size_t               size)
+{
+	const size_t divisor      = sizeof(long long int);
+	const size_t numberofints = size/divisor;
+	      size_t remainder    = size % divisor;
+
+	      long long int * dst_u64 = (      long long int *)dst;
+	const long long int * src_u64 = (const long long int *)src;
+	for (size_t i = 0; i < numberofints; i++) {
+		*dst_u64 = *src_u64;
+		++dst_u64;
+		++src_u64;
+	}
+
+	dst = (      char *)dst_u64;
+	src = (const char *)src_u64;
+	while (remainder) {
+		*dst = *src;
+		++dst;
+		++src;
+
+		--remainder;
+	}
+}
+
+// One vector per iteration, LOADU/STOREU accept any address
+TARGET INLINE void *vec_unal(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	const size_t divisor      = sizeof(vec_t);
+	const size_t numberofvecs = size/divisor;
+	const size_t remainder    = size % divisor;
+
+	      vec_t * dst_v = (      vec_t *)dest_;
+	const vec_t * src_v = (const vec_t *)src_;
+	for (size_t i = 0; i < numberofvecs; i++) {
+		STOREU(dst_v, LOADU(src_v));
+		++dst_v;
+		++src_v;
+	}
+
+	tail((char *)dst_v, (const char *)src_v, remainder);
+
+	return dest_;
+}
+
+#if VEC_ALIGNED
+// Same loop with LOAD/STORE, which fault on addresses not divisible by VEC_WIDTH
+TARGET INLINE void *vec_al(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	const size_t divisor      = sizeof(vec_t);
+	const size_t numberofvecs = size/divisor;
+	const size_t remainder    = size % divisor;
+
+	      vec_t * dst_v = __builtin_assume_aligned((      vec_t *)dest_, VEC_WIDTH);
+	const vec_t * src_v = __builtin_assume_aligned((const vec_t *)src_,  VEC_WIDTH);
+	for (size_t i = 0; i < numberofvecs; i++) {
+		STORE(dst_v, LOAD(src_v));
+		++dst_v;
+		++src_v;
+	}
+
+	tail((char *)dst_v, (const char *)src_v, remainder);
+
+	return dest_;
+}
+
+/*
+	Aligned loads and stores when both pointers allow it,
+	unaligned ones otherwise
+*/
+TARGET void *VEC_NAME(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	if (((uintptr_t)src_) % VEC_WIDTH == 0 && ((uintptr_t)dest_) % VEC_WIDTH == 0) {
+		vec_al(dest_, src_, size);
+
+	} else {
+		vec_unal(dest_, src_, size);
+	}
+
+	return dest_;
+}
+
+#else
+// Unaligned loads and stores for the whole buffer
+TARGET void *VEC_NAME(
+	      void *restrict const dest_,
+	const void *restrict const src_,
+	size_t                     size)
+{
+	return vec_unal(dest_, src_, size);
+}
+#endif
+
+// _al falls back to unaligned loads and stores, so both take any address
+KERNEL_DESC(VEC_NAME, FEATURES, 1, 0, 0);
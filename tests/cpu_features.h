@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <cpuid.h>
+
+#include "perf_utils.h"
+
+/*
+	Header only and freestanding, so it works both in perf_utils.so
+	and in ifunc resolvers in implementations/, which run before libc is usable
+*/
+
+/*
+	Vector extensions used by the kernels in implementations/
+
+	Leaf 1 and leaf 7 tell what the cpu can do,
+	xgetbv (XCR0) tells which registers the OS saves on context switch.
+	Without the second check AVX code can still fault with #UD.
+*/
+static inline uint32_t detect_cpu_features(void) {
+
+	uint32_t features = 0;
+	uint32_t eax=0, ebx=0, ecx=0, edx=0;
+
+	__cpuid(0x00000000, eax, ebx, ecx, edx);
+	
+	uint32_t max_basic_leaf = eax;
+	if (max_basic_leaf < 0x00000001)
+		return features;
+
+	eax = 0, ebx = 0, ecx = 0, edx = 0;
+	__cpuid(0x00000001, eax, ebx, ecx, edx);
+
+	if (edx & (1 << 26))
+		features |= CPU_SSE2;
+
+	uint64_t xcr0 = 0;
+	if (ecx & (1 << 27)) { // OSXSAVE
+
+		uint32_t xcr0_lo, xcr0_hi;
+		asm volatile(
+			"xgetbv"
+			: "=a" (xcr0_lo), "=d" (xcr0_hi) // out
+			: "c"  (0)			 // in, XCR0
+		);
+		xcr0 = (uint64_t)xcr0_hi << 32 | xcr0_lo;
+	}
+
+	// XMM | YMM state, then opmask | ZMM_Hi256 | Hi16_ZMM
+	const uint64_t ymm_state = 0x06,
+		       zmm_state = 0xe0;
+
+	if (max_basic_leaf < 0x00000007)
+		return features;
+
+	eax = 0, ebx = 0, ecx = 0, edx = 0;
+	__cpuid_count(0x00000007, 0, eax, ebx, ecx, edx);
+
+	if ((xcr0 & ymm_state) == ymm_state && (ebx & (1 << 5)))
+		features |= CPU_AVX2;
+
+	if ((xcr0 & (ymm_state | zmm_state)) == (ymm_state | zmm_state) && (ebx & (1 << 16)))
+		features |= CPU_AVX512F;
+
+	// rep movsb doesn't depend on OS state
+	if (ebx & (1 << 9))
+		features |= CPU_ERMS;
+
+	if (edx & (1 << 4))
+		features |= CPU_FSRM;
+
+	return features;
+}
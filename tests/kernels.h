@@ -0,0 +1,113 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <dirent.h>
+#include <dlfcn.h>
+
+#include "perf_utils.h"
+#include "memcpy.h"
+
+/*
+	Kernels are found at run time, shared by tests and self_tests
+	A kernel is any <name>.so that exports a KernelDesc as <name>_kernel,
+	adding one only takes dropping its .so into the directory
+*/
+
+#define KERNEL_NAME_SIZE	64
+
+typedef struct {
+	char       name[KERNEL_NAME_SIZE];
+	KernelDesc desc;
+	memcpy_t   func;
+	void      *handle; // dlopen handle, for tunables like <name>_set_threshold
+} Kernel;
+
+static inline int kernel_comp(const void *lhs_, const void *rhs_) {
+	const Kernel *lhs = (const Kernel *)lhs_;
+	const Kernel *rhs = (const Kernel *)rhs_;
+
+	return strcmp(lhs->name, rhs->name);
+}
+
+/*
+	dlopens every .so in dir, keeps the ones with a descriptor
+	whose features are all in features, sorted by name.
+	Anything else is closed again, so perf_utils.so next to the kernels is fine.
+	*list is malloc'd, returns how many kernels it holds
+*/
+static inline size_t discover_kernels(const char *dir, uint32_t features, Kernel **list) {
+
+	*list = NULL;
+
+	DIR *d = opendir(dir);
+	if (!d) {
+		perror(dir);
+		return 0;
+	}
+
+	size_t count = 0, capacity = 0;
+	for (struct dirent *ent = readdir(d); ent; ent = readdir(d)) {
+
+		const size_t len = strlen(ent->d_name);
+		if (len <= strlen(".so") || strcmp(ent->d_name + len - strlen(".so"), ".so") != 0)
+			continue;
+
+		if (len - strlen(".so") >= KERNEL_NAME_SIZE) {
+			printf("Skipping %s, name too long\n", ent->d_name);
+			continue;
+		}
+
+		char name[KERNEL_NAME_SIZE], path[4096], symbol[KERNEL_NAME_SIZE + 16];
+		snprintf(name,   sizeof(name),   "%.*s", (int)(len - strlen(".so")), ent->d_name);
+		snprintf(path,   sizeof(path),   "%s/%s", dir, ent->d_name);
+		snprintf(symbol, sizeof(symbol), "%s_kernel", name);
+
+		void *f = dlopen(path, RTLD_NOW);
+		if (!f) {
+			printf("dlopen error: %s\n", dlerror());
+			continue;
+		}
+
+		// Not a kernel
+		const KernelDesc *desc = (const KernelDesc *)dlsym(f, symbol);
+		if (!desc) {
+			dlclose(f);
+			continue;
+		}
+
+		if ((features & desc->features) != desc->features) {
+			printf("Skipping %s, cpu features missing\n", name);
+			dlclose(f);
+			continue;
+		}
+
+		memcpy_t func = (memcpy_t)dlsym(f, name);
+		if (!func || strcmp(desc->name, name) != 0) {
+			printf("Skipping %s, no %s() or the descriptor names %s\n", name, name, desc->name);
+			dlclose(f);
+			continue;
+		}
+
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			*list    = realloc(*list, capacity * sizeof((*list)[0]));
+			if (!*list) {
+				printf("Realloc failed in discover_kernels()\n");
+				exit(1);
+			}
+		}
+
+		Kernel *k = &(*list)[count++];
+		strcpy(k->name, name);
+		k->desc      = *desc; // desc.name points into f, which stays open
+		k->func      = func;
+		k->handle    = f;
+	}
+	closedir(d);
+
+	qsort(*list, count, sizeof((*list)[0]), &kernel_comp);
+	return count;
+}
@@ -1,7 +1,30 @@
 #include <stddef.h>
+#include <stdint.h>
 
 #pragma once
+#include "perf_utils.h" // CPU_* bits of KernelDesc.features
+
 typedef void *(*memcpy_t) (
-	      void *restrict const, 
+	      void *restrict const,
 	const void *restrict const,
 	size_t);
+
+/*
+	Every kernel in implementations/ exports one as <name>_kernel,
+	next to the copy function <name>, see discover_kernels() in kernels.h
+	Freestanding, kernels are built with -nostdlib
+*/
+typedef struct {
+	const char *name;      // copy function, also the .so name
+	uint32_t    features;  // CPU_* bits the host needs to run it
+	size_t      alignment; // src and dst alignment it requires, 1 for any
+	size_t      min_size;  // copy sizes it handles, max_size 0 for no limit
+	size_t      max_size;
+} KernelDesc;
+
+/*
+	KERNEL_DESC(cmemcpy, 0, 1, 0, 0);
+	Goes through a second macro so that name_ can be a macro itself, like GEN_NAME
+*/
+#define KERNEL_DESC__(name_, ...) const KernelDesc name_##_kernel = { #name_, __VA_ARGS__ }
+#define KERNEL_DESC(name_, ...)   KERNEL_DESC__(name_, __VA_ARGS__)
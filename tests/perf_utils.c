@@ -1,4 +1,14 @@
+#define _GNU_SOURCE 	// CLOCK_MONOTONIC_RAW
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include <stdint.h>
 #include <inttypes.h>
@@ -7,6 +17,7 @@
 #include <cpuid.h> 	// __get_cpuid from gcc extension as an alternative
 
 #include "perf_utils.h"
+#include "cpu_features.h"
 
 /*
 
@@ -46,12 +57,35 @@ void cpuid(void) {
 	);
 }
 
+// Body lives in cpu_features.h, so that implementations/ can use it without libc
+uint32_t cpu_features(void) {
+	return detect_cpu_features();
+}
+
+Tsccal tsc_calibrate(void);
+
 // This evolved over time into a function that checks both rdtsc and invariant_tsc
 Cpustat cpuid_gcc(void) {
 
-	Cpustat retvals = {0,0,0,0};
+	Cpustat retvals = {0};
 	
+	retvals.features = cpu_features();
+
+	printf("Features: sse2 %d, avx2 %d, avx512f %d, erms %d, fsrm %d\n",
+		!!(retvals.features & CPU_SSE2),
+		!!(retvals.features & CPU_AVX2),
+		!!(retvals.features & CPU_AVX512F),
+		!!(retvals.features & CPU_ERMS),
+		!!(retvals.features & CPU_FSRM));
+
 	uint32_t eax=0, ebx=0, ecx=0, edx=0;
+	__cpuid(0x00000001, eax, ebx, ecx, edx);
+
+	retvals.has_rdtsc = edx & (1 << 4);
+
+	printf("Has rdtsc: %" PRIu32 "\n", retvals.has_rdtsc);
+
+	eax = 0, ebx = 0, ecx = 0, edx = 0;
 	__cpuid(0x80000000, eax, ebx, ecx, edx);
 	
 	retvals.max_leaf = eax;
@@ -63,9 +97,9 @@ Cpustat cpuid_gcc(void) {
 	eax = 0, ebx = 0, ecx = 0, edx = 0;
 	__cpuid(0x80000001, eax, ebx, ecx, edx);
  	
-	retvals.has_rdtsc = edx & (1 << 27);
+	retvals.has_rdtscp = edx & (1 << 27);
 	
-	printf("Has rdtsc: %" PRIu32 "\n", retvals.has_rdtsc);
+	printf("Has rdtscp: %" PRIu32 "\n", retvals.has_rdtscp);
 	
 	if (retvals.max_leaf <= 0x80000007)
 		return retvals;
@@ -80,17 +114,11 @@ Cpustat cpuid_gcc(void) {
 	if (retvals.has_invariant_tsc == 0) 
 		return retvals;
 	
-	eax = 0, ebx = 0, ecx = 0, edx = 0;
-	__cpuid(0x00000015, eax, ebx, ecx, edx);
+	Tsccal cal = tsc_calibrate();
 
-	printf("Subvalues of leaf 0x15: ");
-	printf("eax %d, ebx %d, ecx %d\n", eax, ebx, ecx);
-	if (eax == 0 || ebx == 0 || ecx == 0)
-		return retvals;
-
-	retvals.clock_rate = ecx * (ebx/eax); 
-	
-	printf("Clock rate: %zu\n", retvals.clock_rate);
+	retvals.clock_rate   = cal.hz;
+	retvals.clock_source = cal.source;
+	retvals.clock_ppm    = cal.ppm;
 
 	return retvals;
 }
@@ -119,3 +147,357 @@ uint64_t rdtsc(void) {
 	// edx:eax
 	return (int64_t)edx << 32 | eax;
 }
+
+/*
+	Begin and end of a timed region, the pattern from Intel's
+	"How to Benchmark Code Execution Times" with lfence in place of cpuid,
+	which costs hundreds of cycles and traps under virtualization.
+
+	begin: lfence waits for everything before it to finish,
+	       the second one keeps the timed code from starting before rdtsc
+	end:   rdtscp waits for the timed code to finish,
+	       lfence keeps whatever comes after from starting before it
+
+	tsc_end() needs rdtscp, check Cpustat.has_rdtscp
+*/
+uint64_t tsc_begin(void) {
+
+	uint32_t eax, edx;
+
+	asm volatile(
+		"lfence\n\t"
+		"rdtsc\n\t"
+		"lfence"
+		: "=a" (eax), "=d" (edx) // out
+		:			 // in
+		: "memory"		 // clobbers
+	);
+
+	return (uint64_t)edx << 32 | eax;
+}
+
+uint64_t tsc_end(void) {
+
+	uint32_t eax, edx;
+
+	asm volatile(
+		"rdtscp\n\t"
+		"lfence"
+		: "=a" (eax), "=d" (edx) // out
+		:			 // in
+		: "ecx", "memory"	 // clobbers, ecx gets IA32_TSC_AUX
+	);
+
+	return (uint64_t)edx << 32 | eax;
+}
+
+/*
+	Cycles an empty tsc_begin() tsc_end() pair reports,
+	the smallest out of TSC_CALIBRATION_COUNT tries.
+	Subtract it from every measurement, otherwise
+	copies under 64 bytes are mostly timer
+*/
+#define TSC_CALIBRATION_COUNT 4096
+
+uint64_t tsc_overhead(void) {
+
+	uint64_t overhead = UINT64_MAX;
+
+	for (size_t i=0; i < TSC_CALIBRATION_COUNT; i++) {
+		
+		const uint64_t start = tsc_begin();
+		const uint64_t end   = tsc_end();
+
+		if (end - start < overhead)
+			overhead = end - start;
+	}
+
+	return overhead;
+}
+
+// TSC ticks per second measured over one window of CLOCK_MONOTONIC_RAW
+#define TSC_MEASURE_NS		20000000
+#define TSC_MEASURE_ROUNDS	7
+
+static int size_comp(const void *lhs_, const void *rhs_) {
+	const size_t lhs = *(const size_t *)lhs_;
+	const size_t rhs = *(const size_t *)rhs_;
+
+	return (lhs > rhs) - (lhs < rhs);
+}
+
+static uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end) {
+	return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000000 + end->tv_nsec - start->tv_nsec;
+}
+
+/*
+	TSC_MEASURE_ROUNDS windows of TSC_MEASURE_NS each,
+	the median is the frequency and half the spread is the precision
+	Each window reads the TSC between two clock reads,
+	so the clock's own latency doesn't end up in the count
+*/
+static Tsccal tsc_measure(void) {
+
+	Tsccal cal = {0, TSC_SRC_NONE, 0};
+	size_t hz[TSC_MEASURE_ROUNDS];
+
+	for (size_t i=0; i < TSC_MEASURE_ROUNDS; i++) {
+
+		struct timespec start, end, now;
+
+		if (clock_gettime(CLOCK_MONOTONIC_RAW, &start) != 0)
+			return cal;
+		const uint64_t tsc_start = tsc_begin();
+
+		do {
+			clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+		} while (elapsed_ns(&start, &now) < TSC_MEASURE_NS);
+
+		const uint64_t tsc_end_ = tsc_begin();
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+		hz[i] = (size_t)((double)(tsc_end_ - tsc_start) * 1e9 / elapsed_ns(&start, &end));
+	}
+
+	qsort(hz, TSC_MEASURE_ROUNDS, sizeof(hz[0]), &size_comp);
+
+	cal.hz     = hz[TSC_MEASURE_ROUNDS / 2];
+	cal.source = TSC_SRC_CLOCK;
+	cal.ppm    = (double)(hz[TSC_MEASURE_ROUNDS - 1] - hz[0]) / 2 / cal.hz * 1e6;
+
+	return cal;
+}
+
+/*
+	TSC frequency from the most trustworthy source available:
+	leaf 0x15 if it lists the crystal clock, the kernel's tsc_freq_khz,
+	a measurement against CLOCK_MONOTONIC_RAW and finally
+	the base frequency from leaf 0x16, which is only nominal.
+	Leaf 0x15 without a crystal (ecx 0) is common on client parts and VMs
+*/
+Tsccal tsc_calibrate(void) {
+
+	Tsccal cal = {0, TSC_SRC_NONE, 0};
+	const char *const names[] = {
+		"none",
+		"cpuid leaf 0x15",
+		"sysfs tsc_freq_khz",
+		"CLOCK_MONOTONIC_RAW",
+		"cpuid leaf 0x16"
+	};
+
+	uint32_t eax=0, ebx=0, ecx=0, edx=0;
+	__cpuid(0x00000000, eax, ebx, ecx, edx);
+
+	const uint32_t max_basic_leaf = eax;
+
+	uint32_t base_mhz = 0;
+	if (max_basic_leaf >= 0x00000016) {
+		eax = 0, ebx = 0, ecx = 0, edx = 0;
+		__cpuid(0x00000016, eax, ebx, ecx, edx);
+		base_mhz = eax & 0xffff;
+	}
+
+	if (max_basic_leaf >= 0x00000015) {
+		eax = 0, ebx = 0, ecx = 0, edx = 0;
+		__cpuid(0x00000015, eax, ebx, ecx, edx);
+
+		printf("Subvalues of leaf 0x15: ");
+		printf("eax %d, ebx %d, ecx %d\n", eax, ebx, ecx);
+
+		// Multiply first, ebx/eax alone truncates the ratio
+		if (eax != 0 && ebx != 0 && ecx != 0) {
+			cal.hz     = (size_t)((uint64_t)ecx * ebx / eax);
+			cal.source = TSC_SRC_CPUID15;
+			cal.ppm    = 0;
+		}
+	}
+
+	if (cal.source == TSC_SRC_NONE) {
+		FILE *f = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "r");
+		size_t khz = 0;
+
+		if (f) {
+			if (fscanf(f, "%zu", &khz) == 1 && khz != 0) {
+				cal.hz     = khz * 1000;
+				cal.source = TSC_SRC_SYSFS;
+				cal.ppm    = 1e9 / cal.hz / 2; // kHz resolution
+			}
+			fclose(f);
+		}
+	}
+
+	if (cal.source == TSC_SRC_NONE)
+		cal = tsc_measure();
+
+	if (cal.source == TSC_SRC_NONE && base_mhz != 0) {
+		cal.hz     = (size_t)base_mhz * 1000000;
+		cal.source = TSC_SRC_CPUID16;
+		cal.ppm    = 1e12 / cal.hz / 2; // MHz resolution, the real TSC may be further off
+	}
+
+	printf("TSC frequency: %zu Hz from %s, +- %.1f ppm\n", cal.hz, names[cal.source], cal.ppm);
+
+	return cal;
+}
+
+/*
+	Two counter groups, a group is scheduled all at once
+	and four events fit in the general purpose counters of every target.
+	With both groups in use the kernel multiplexes them,
+	pmu_stop() scales the counts by how long each one ran
+*/
+#define PMU_GROUP_COUNT 2
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+	uint32_t group;
+} pmu_events[PMU_COUNT] = {
+	[PMU_CYCLES]        = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,   0 },
+	[PMU_INSTRUCTIONS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0 },
+	[PMU_L1D_MISSES]    = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+					      | PERF_COUNT_HW_CACHE_OP_READ       << 8
+					      | PERF_COUNT_HW_CACHE_RESULT_MISS   << 16, 0 },
+	[PMU_LLC_MISSES]    = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 0 },
+	[PMU_DTLB_MISSES]   = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+					      | PERF_COUNT_HW_CACHE_OP_READ       << 8
+					      | PERF_COUNT_HW_CACHE_RESULT_MISS   << 16, 1 },
+	// Raw, filled in by pmu_raw_events()
+	[PMU_ALIASING]      = { PERF_TYPE_RAW,      0,                          1 },
+	[PMU_STORE_FORWARD] = { PERF_TYPE_RAW,      0,                          1 },
+};
+
+static int pmu_fd    [PMU_COUNT]       = { -1, -1, -1, -1, -1, -1, -1 };
+static int pmu_leader[PMU_GROUP_COUNT] = { -1, -1 };
+
+/*
+	umask << 8 | event of LD_BLOCKS(_PARTIAL).ADDRESS_ALIAS and LD_BLOCKS.STORE_FORWARD
+	Golden Cove and Raptor Cove (alder lake, raptor lake, sapphire rapids,
+	emerald rapids) moved them, everything else in family 6 uses the skylake codes.
+	0 when the cpu isn't Intel, those events don't exist there
+*/
+static void pmu_raw_events(uint64_t *aliasing, uint64_t *store_forward) {
+
+	*aliasing      = 0;
+	*store_forward = 0;
+
+	uint32_t eax=0, ebx=0, ecx=0, edx=0;
+	__cpuid(0x00000000, eax, ebx, ecx, edx);
+
+	// "GenuineIntel" in ebx edx ecx
+	if (ebx != 0x756e6547 || edx != 0x49656e69 || ecx != 0x6c65746e)
+		return;
+
+	eax = 0, ebx = 0, ecx = 0, edx = 0;
+	__cpuid(0x00000001, eax, ebx, ecx, edx);
+
+	const uint32_t family = (eax >> 8) & 0xf,
+		       model  = ((eax >> 4) & 0xf) | ((eax >> 12) & 0xf0);
+	if (family != 6)
+		return;
+
+	const uint32_t golden_cove[] = { 0x97, 0x9a, 0xb7, 0xba, 0xbf, 0x8f, 0xcf };
+	for (size_t i=0; i < sizeof(golden_cove) / sizeof(golden_cove[0]); i++) {
+		if (model == golden_cove[i]) {
+			*aliasing      = 0x0403;
+			*store_forward = 0x8203;
+			return;
+		}
+	}
+
+	*aliasing      = 0x0107;
+	*store_forward = 0x0203;
+}
+
+/*
+	Opens every counter the cpu, the kernel and perf_event_paranoid allow
+	for this thread, user space only. Counters that fail are left out,
+	returns a PMU_* bit for each one that opened, 0 means none did
+	Safe to call again, counters already open stay as they are
+*/
+uint32_t pmu_open(void) {
+
+	uint64_t raw[PMU_COUNT] = {0};
+	pmu_raw_events(&raw[PMU_ALIASING], &raw[PMU_STORE_FORWARD]);
+
+	uint32_t opened = 0;
+	for (size_t i=0; i < PMU_COUNT; i++) {
+
+		if (pmu_fd[i] != -1) {
+			opened |= 1u << i;
+			continue;
+		}
+
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+
+		attr.size           = sizeof(attr);
+		attr.type           = pmu_events[i].type;
+		attr.config         = pmu_events[i].type == PERF_TYPE_RAW ? raw[i] : pmu_events[i].config;
+		attr.disabled       = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv     = 1;
+		attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		if (attr.type == PERF_TYPE_RAW && attr.config == 0)
+			continue;
+
+		// First counter of a group that opens becomes its leader
+		int *leader = &pmu_leader[pmu_events[i].group];
+
+		const int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, *leader, 0);
+		if (fd == -1)
+			continue;
+
+		if (*leader == -1)
+			*leader = fd;
+
+		pmu_fd[i] = fd;
+		opened   |= 1u << i;
+	}
+
+	return opened;
+}
+
+// Zero and enable every group
+void pmu_start(void) {
+
+	for (size_t g=0; g < PMU_GROUP_COUNT; g++) {
+		if (pmu_leader[g] == -1)
+			continue;
+
+		ioctl(pmu_leader[g], PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+		ioctl(pmu_leader[g], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+}
+
+/*
+	Disable every group and read the counts since pmu_start(),
+	scaled up for the time a multiplexed group didn't run
+*/
+Pmu pmu_stop(void) {
+
+	Pmu pmu = {{0}, 0};
+
+	for (size_t g=0; g < PMU_GROUP_COUNT; g++) {
+		if (pmu_leader[g] != -1)
+			ioctl(pmu_leader[g], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	}
+
+	for (size_t i=0; i < PMU_COUNT; i++) {
+
+		// value, time enabled, time running
+		uint64_t buf[3];
+		if (pmu_fd[i] == -1 || read(pmu_fd[i], buf, sizeof(buf)) != sizeof(buf))
+			continue;
+
+		if (buf[2] == 0)
+			continue;
+
+		pmu.value[i] = buf[2] < buf[1] ? (uint64_t)((double)buf[0] * buf[1] / buf[2]) : buf[0];
+		pmu.valid   |= 1u << i;
+	}
+
+	return pmu;
+}
@@ -1,14 +1,62 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
+// Bits of Cpustat.features, set only if both cpu and OS support them
+#define CPU_SSE2	(1u << 0)
+#define CPU_AVX2	(1u << 1)
+#define CPU_AVX512F	(1u << 2)
+#define CPU_ERMS	(1u << 3) // Enhanced rep movsb/stosb
+#define CPU_FSRM	(1u << 4) // Fast short rep mov
+
+// Where Cpustat.clock_rate came from, see tsc_calibrate()
+#define TSC_SRC_NONE	0
+#define TSC_SRC_CPUID15	1 // crystal clock * TSC ratio, exact
+#define TSC_SRC_SYSFS	2 // tsc_freq_khz, the kernel's own calibration
+#define TSC_SRC_CLOCK	3 // measured against CLOCK_MONOTONIC_RAW
+#define TSC_SRC_CPUID16	4 // nominal base frequency, last resort
+
+typedef struct {
+	size_t   hz;
+	uint32_t source; // TSC_SRC_*
+	double   ppm;    // how far off hz could be, in parts per million
+} Tsccal;
+
+// Hardware counters, index of Pmu.value, bit of Pmu.valid
+#define PMU_CYCLES		0
+#define PMU_INSTRUCTIONS	1
+#define PMU_L1D_MISSES		2 // L1D load misses
+#define PMU_LLC_MISSES		3
+#define PMU_DTLB_MISSES		4 // dTLB load misses
+#define PMU_ALIASING		5 // loads blocked by 4K aliasing, Intel only
+#define PMU_STORE_FORWARD	6 // loads blocked by a failed store forward, Intel only
+#define PMU_COUNT		7
+
+typedef struct {
+	uint64_t value[PMU_COUNT];
+	uint32_t valid; // bit per counter that was open and got scheduled
+} Pmu;
+
 typedef struct{
 	size_t   clock_rate;
+	uint32_t clock_source;
+	double   clock_ppm;
 	uint32_t max_leaf;
 	uint32_t has_rdtsc;
+	uint32_t has_rdtscp;
 	uint32_t has_invariant_tsc;	
+	uint32_t features;
 } Cpustat;
 
 typedef void     (*cpuid_t)       (void);
 typedef uint64_t (*rdtsc_t)       (void);
 typedef uint64_t (*rdtsc_intel_t) (void);
 typedef Cpustat  (*cpuid_gcc_t)   (void);
+typedef uint32_t (*cpu_features_t)(void);
+typedef uint64_t (*tsc_begin_t)   (void);
+typedef uint64_t (*tsc_end_t)     (void);
+typedef uint64_t (*tsc_overhead_t)(void);
+typedef Tsccal   (*tsc_calibrate_t)(void);
+typedef uint32_t (*pmu_open_t)    (void);
+typedef void     (*pmu_start_t)   (void);
+typedef Pmu      (*pmu_stop_t)    (void);
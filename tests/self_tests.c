@@ -17,11 +17,15 @@
 
 #include "perf_utils.h"
 #include "memcpy.h"
+#include "kernels.h"
 
 #include "assert.h"
 
 #define MALLOC_SIZE   (1 << 12)
 
+#define CHECK_SIZE    (1 << 10)
+#define CHECK_GUARD   64
+
 #define BUILD_BUG_ON_ZERO(expr) ((int)(sizeof(struct { int:(-!!(expr)); })))
 
 #define __same_type(a,b) __builtin_types_compatible_p(typeof(a), typeof(b))
@@ -34,6 +38,53 @@
 
 size_t clock_frequency = 0;
 
+typedef void (*set_threshold_t)(size_t);
+
+/*
+	Check against libc memcpy for every size up to CHECK_SIZE
+	the kernel's descriptor allows and every src/dst offset within a cache line.
+	Bytes around the copied range have to stay untouched
+*/
+int check_memcpy(const Kernel *k) {
+
+	const char *name   = k->name;
+	memcpy_t    tested = k->func;
+
+	unsigned char *src = (unsigned char *)malloc(CHECK_SIZE + 2 * CHECK_GUARD),
+		      *dst = (unsigned char *)malloc(CHECK_SIZE + 2 * CHECK_GUARD),
+		      *ref = (unsigned char *)malloc(CHECK_SIZE + 2 * CHECK_GUARD);
+	assert(src && dst && ref && "Malloc failed");
+
+	for (size_t j=0; j < CHECK_SIZE + 2 * CHECK_GUARD; j++)
+		src[j] = (unsigned char)(j * 7 + 3);
+
+	int failed = 0;
+	for (size_t off=0; off < CHECK_GUARD && !failed; off++) {
+		for (size_t size=k->desc.min_size; size <= CHECK_SIZE - CHECK_GUARD; size++) {
+
+			if (k->desc.max_size && size > k->desc.max_size)
+				break;
+
+			memset(dst, 0xa5, CHECK_SIZE + 2 * CHECK_GUARD);
+			memset(ref, 0xa5, CHECK_SIZE + 2 * CHECK_GUARD);
+
+			tested(dst + CHECK_GUARD + off, src + off * 3 % CHECK_GUARD, size);
+			memcpy(ref + CHECK_GUARD + off, src + off * 3 % CHECK_GUARD, size);
+
+			if (memcmp(dst, ref, CHECK_SIZE + 2 * CHECK_GUARD) != 0) {
+				printf("%s failed, size %zu, offset %zu\n", name, size, off);
+				failed = 1;
+				break;
+			}
+		}
+	}
+	free(src);
+	free(dst);
+	free(ref);
+
+	return failed;
+}
+
 int main(void) {
 
 	// PURPOSE OF THIS SECTION: Pin this process to only one core in order to measure performance
@@ -125,38 +176,40 @@ int main(void) {
 			printf("\n");
 	} printf("\n");
 
-	const uint64_t mcount = 5;
-	const char *mnlist[] = {
-		"cmemcpy",     
-		"cmemcpy2",    
-		"cmemcpy3",    
-		"cmemcpy_al",  
-		"cmemcpy_unal"	
-	};
-	assert(ARRAY_SIZE(mnlist) == mcount);
+	Kernel *kernels = NULL;
+	const size_t kcount = discover_kernels(".", cpustat.features, &kernels);
+	if (kcount == 0) {
+		printf("No kernels in ./, make link puts them here\n");
+		return 1;
+	}
 
-	char mlist[mcount][1024];
-	void *f[mcount];
+	memcpy_t cmemcpy[kcount];
+	uint64_t loaded = 0;
 
-	for (uint64_t i=0; i < mcount; i++) {
-		snprintf(mlist[i], sizeof(mlist[i]), "./%s.so", mnlist[i]);
-		f[i] = dlopen(mlist[i], RTLD_NOW);
-		if (!f[i]) {
-			perror("dlopen");
-			return 1;
-		}
-	}
+	for (size_t i=0; i < kcount; i++) {
 
-	char *err[mcount];
-	memcpy_t cmemcpy[mcount];
-	for (uint64_t i=0; i < mcount; i++) {
-		cmemcpy[i] = (memcpy_t)dlsym(f[i], mnlist[i]);
-		err[i] = dlerror();
+		const Kernel *k = &kernels[i];
+		cmemcpy[loaded] = k->func;
 
-		if (err[i]) {
-			printf("dlsym error: %s\n", err[i]);
+		if (check_memcpy(k))
 			return 1;
+
+		/*
+			Kernels with a size threshold take another path above it,
+			drop it to 0 to make the check go through that one too
+		*/
+		char setter[1024];
+		snprintf(setter, sizeof(setter), "%s_set_threshold", k->name);
+
+		set_threshold_t set_threshold = (set_threshold_t)dlsym(k->handle, setter);
+		if (set_threshold) {
+			set_threshold(0);
+			if (check_memcpy(k))
+				return 1;
 		}
+
+		printf("%s passed\n", k->name);
+		loaded++;
 	}
 	
 	const char *data[] = {
@@ -168,15 +221,14 @@ int main(void) {
 		"Did you know that orangutans use medicine?\n",
 		"Did you know that male seahorses give birth?\n"
 	};
-	assert(ARRAY_SIZE(data) == mcount);
 
 	char *dest = (char *)malloc(MALLOC_SIZE);
 	assert(dest && "Malloc failed");
 	
 	size_t addr=0;
-	for (uint64_t i=0; i < mcount; i++) {	
+	for (uint64_t i=0; i < ARRAY_SIZE(data); i++) {	
 		size_t len = strlen(data[i]);
-		cmemcpy[i](dest+addr, data[i], len);
+		cmemcpy[i % loaded](dest+addr, data[i], len);
 		addr+=len;
 	}
 
@@ -4,12 +4,19 @@
 
 #include <sched.h>      // Set thread's CPU affinity
 #include <unistd.h> 	// System-related functions like getpid()
+#include <sys/mman.h>
+#include <sys/utsname.h>    // Kernel version for the run metadata
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h> // MPOL_* for mbind(), without libnuma
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <errno.h>
+#include <limits.h>
 
 #include <stdint.h>
 #include <inttypes.h>
@@ -17,27 +24,94 @@
 
 #include <dlfcn.h> 	// dynamic linking library 
 
+#include <immintrin.h>	// _mm_clflush() for --residency=flush
+
 #include "perf_utils.h"
 #include "memcpy.h"
+#include "kernels.h"
 
 #define TEXT_MAX_SIZE  (1 << 19)
+#define COPY_MAX_SIZE  (1 << 28) // Has to be well past the LLC of every ARCH target
 #define TITLE_MAX_SIZE (1 << 9 )
+#define PATTERN_MAX_SIZE (1 << 9 ) // Entry text, fill() repeats it up to the copy size
 
 #define SINGLE_TEST_COUNT	3
 
+// test_small_sizes() covers every size from 1 to this
+#define SMALL_MAX_SIZE		128
+
+// test_prefetch_distances() sizes, TEXT_MAX_SIZE * 2, * 8, ... all past L2
+#define PREFETCH_SIZE_COUNT	4
+
 #define PATTERN_COUNT		2
 #define PATTERN_REPEAT_COUNT	4
 
-#define MEMCPY_COUNT		6
+// test_thread_scaling() sizes, COPY_MAX_SIZE, / 4, ... all past the LLC
+#define THREAD_SIZE_COUNT	3
+
+// test_numa_matrix() copy size and the most nodes it looks at
+#define NUMA_COPY_SIZE		((COPY_MAX_SIZE) / 4)
+#define NUMA_MAX_NODES		64
+
+// TEXT_MAX_SIZE * 2, * 8, ... up to COPY_MAX_SIZE
+#define LARGE_REPEAT_COUNT	5
+
+// Defaults of --warmup and --runs
 #define WARMUP_COUNT		666
 #define RUN_COUNT		1024	 
 
-#define UNIQUE_TEST_COUNT	((SINGLE_TEST_COUNT) + (PATTERN_COUNT))
-#define TEST_COUNT		((SINGLE_TEST_COUNT) + ((PATTERN_COUNT) * (PATTERN_REPEAT_COUNT)))
-#define FULL_TEST_COUNT		(TEST_COUNT * MEMCPY_COUNT)
+// measure_time() samples, each one is a batch of calls
+#define SAMPLE_MIN_COUNT	32
+#define SAMPLE_MAX_COUNT	4096
+#define SAMPLE_CI_TARGET	0.01	// stop once the 95% CI is within 1% of the mean
+#define SAMPLE_FENCE		3	// IQRs past the quartiles before a sample is an outlier
+
+// Large copies get fewer runs, so that one cell doesn't copy more than this
+#define RUN_MAX_BYTES		(1ull << 28)
+
+// --sizes=curve covers every size up to this, then goes log-spaced
+#define CURVE_LINEAR_MAX	256
+#define CURVE_OCTAVE		8	// default sizes per doubling after that
+
+// Most entries --sizes can make, every one is a result row per kernel
+#define SWEEP_MAX_COUNT		4096
+
+/*
+	Where src and dst are when a sample starts, see prepare_residency()
+	HOT is the plain loop over the same buffers, every other one
+	times single calls and gets the buffers ready before each of them
+*/
+#define RESIDENCY_HOT		0
+#define RESIDENCY_COLD		1 // next buffers out of a pool COLD_POOL_LLCS times the LLC
+#define RESIDENCY_FLUSH		2 // clflush every line of src and dst
+#define RESIDENCY_L1		3 // touched right before, only sizes that fit L1D
+#define RESIDENCY_L2		4 // touched, then pushed out of L1D, only sizes that fit L2
+#define RESIDENCY_COUNT		5
+
+#define COLD_POOL_LLCS		2
+
+// --replay, calls drawn from a histogram or model, a trace is replayed as it is up to REPLAY_MAX_CALLS
+#define REPLAY_CALLS		8192
+#define REPLAY_MAX_CALLS	(1 << 20)
+
+// --random, calls per bucket, sizes and offsets drawn once up front
+#define RANDOM_CALLS		1024
+#define RANDOM_BUCKETS		"0:16,17:64,65:256,257:1k,1025:4k"
+
+// rng_next() seed, fixed so every kernel and every run gets the same calls
+#define RNG_SEED		0x9e3779b97f4a7c15ull
+
+// --offsets runs every src and dst offset from 0 to this - 1
+#define OFFSET_COUNT		64
+
+// Tests of the default matrix, --sizes replaces them with a sweep
+#define TEST_COUNT		((SINGLE_TEST_COUNT) + ((PATTERN_COUNT) * (PATTERN_REPEAT_COUNT)) + (LARGE_REPEAT_COUNT))
 
 #define COLOR_MAX_SIZE		512
 
+// Written by implementations/Makefile, ARCH and tunables the kernels were built with
+#define BUILD_FLAGS_PATH	"./../implementations/build_flags.txt"
+
 // positive value ? -1 : 0
 // -1 is invalid size
 #define BUILD_BUG_ON_ZERO(expr) ((int)(sizeof(struct { int:(-!!(expr)); })))
@@ -59,6 +133,52 @@
 
 size_t clock_rate = 0;
 
+/*
+	Test matrix, main() fills it from the command line,
+	everything left out keeps the built in default
+*/
+struct {
+	const char *kernel_dir;  // --kernel-dir, where discover_kernels() looks
+	const char **kernels;    // --kernels, empty for every kernel
+	size_t      kernel_count;
+
+	size_t      size_min;  // --sizes, size_max 0 for the default tests
+	size_t      size_max;
+	size_t      size_step;
+	int         size_mul;  // step multiplies instead of adds
+	int         size_curve;   // --sizes=curve, see curve_size()
+	size_t      curve_octave;
+
+	int         aligns[2]; // --align, 8 unaligned, 64 aligned
+	size_t      align_count;
+
+	int         residencies[RESIDENCY_COUNT]; // --residency, RESIDENCY_*
+	size_t      residency_count;
+
+	const char *replay;       // --replay, a file or "fleet", replaces the result tables
+
+	size_t     *random_lo;    // --random, size buckets, replaces the result tables
+	size_t     *random_hi;
+	size_t      random_count;
+
+	size_t     *offset_sizes; // --offsets, replaces the result tables
+	size_t      offset_size_count;
+
+	size_t      warmup;
+	size_t      runs;
+	int         cpu;       // --cpu, -1 for the last online one
+	int         matrix_only;
+} config = {
+	.kernel_dir  = ".",
+	.aligns      = { 8, 64 },
+	.align_count = 2,
+	.residencies = { RESIDENCY_HOT },
+	.residency_count = 1,
+	.warmup      = WARMUP_COUNT,
+	.runs        = RUN_COUNT,
+	.cpu         = -1,
+};
+
 typedef struct {
 	char   *array_pt;
 	size_t  array_len;
@@ -82,40 +202,149 @@ struct {
 	rdtsc_intel_t	rdtsc_intel;
 	cpuid_t		cpuid;
 	cpuid_gcc_t     cpuid_gcc;
+	tsc_begin_t	tsc_begin;
+	tsc_end_t	tsc_end;
+	pmu_open_t	pmu_open;
+	pmu_start_t	pmu_start;
+	pmu_stop_t	pmu_stop;
 } utils;
 
+// PMU_* bits of the counters pmu_open() got, 0 leaves the counter columns out
+uint32_t pmu_opened = 0;
+
+// Set when the cpu has rdtscp, timer_begin() and timer_end() use lfence then
+int    has_rdtscp     = 0;
+
+// Cycles an empty timer_begin() timer_end() pair takes, subtracted from every sample
+size_t timer_overhead = 0;
+
+/*
+	Timed region boundaries, rdtscp + lfence if possible,
+	otherwise cpuid serializes and plain rdtsc reads the counter
+*/
+uint64_t timer_begin(void) {
+
+	if (has_rdtscp)
+		return utils.tsc_begin();
+
+	utils.cpuid();
+	asm volatile("":::"memory");
+
+	return utils.rdtsc();
+}
+
+uint64_t timer_end(void) {
+
+	if (has_rdtscp)
+		return utils.tsc_end();
+
+	utils.cpuid();
+	asm volatile("":::"memory");
+
+	return utils.rdtsc();
+}
+
+#define TIMER_CALIBRATION_COUNT	4096
+
+/*
+	timer_overhead, the smallest of TIMER_CALIBRATION_COUNT empty timer_begin()
+	timer_end() pairs, the same calls measure_time() makes around its batches
+*/
+size_t calibrate_timer(void) {
+
+	size_t overhead = SIZE_MAX;
+
+	for (size_t i=0; i < TIMER_CALIBRATION_COUNT; i++) {
+
+		const uint64_t start = timer_begin();
+		const uint64_t end   = timer_end();
+
+		if (end - start < overhead)
+			overhead = end - start;
+	}
+
+	return overhead;
+}
+
 typedef struct {
 	memcpy_t func; 
 	char	 name[TITLE_MAX_SIZE];
+	void	*handle; // dlopen handle for tunables, NULL for libc memcpy
+	size_t	 min_size; // from the KernelDesc, max_size 0 for no limit
+	size_t	 max_size;
+	size_t	 alignment; // from the KernelDesc, 1 for any, 0 for libc memcpy
 } Memcpy;
 
+// Every kernel that got loaded, grows with add_memcpy()
 struct {
-	Memcpy arr[MEMCPY_COUNT];
+	Memcpy *arr;
+	size_t  count;
 } tested_memcpy;
 
 typedef struct {
 	char 	 name[TITLE_MAX_SIZE];
-	char 	 text[TEXT_MAX_SIZE];
+	char 	 text[PATTERN_MAX_SIZE];
 	size_t 	 reps;
 	size_t 	 size;
 } Entry;
 
+// Allocated once by alloc_entries(), generate_pattern_reps() keeps pointers into it
+struct {
+	Entry  *arr;
+	size_t  count;
+} entries;
+
+// Cycles per call, see measure_time()
 typedef struct {
-	Entry arr[TEST_COUNT];
-} Entries;
-Entries entries;
+	size_t min;
+	size_t median;
+	size_t p90;
+	size_t p99;
+	size_t max;
+	double mean;
+	double stddev;
+	size_t samples;
+	size_t rejected; // outside the outlier fences, left out of mean and stddev
+} Stats;
+
+// measure_time() scratch space, one sample per batch
+size_t samples[SAMPLE_MAX_COUNT];
 
 typedef struct {
 	char 	test_name  [TITLE_MAX_SIZE];
 	char 	memcpy_name[TITLE_MAX_SIZE];
 	size_t 	size;
-	size_t 	difftime;
+	size_t 	difftime; // stats.median, what results are sorted and compared by
+	Stats	stats;
+	double	events[PMU_COUNT]; // per call, see count_events()
+	uint32_t events_valid;
+	int	align;	// 8 unaligned, 64 aligned, see test_memcpy_set()
+	int	residency; // RESIDENCY_*
 } Result;
 
+// One row per kernel and entry, test_memcpy_set() sizes it
 struct {
-	Result	arr[FULL_TEST_COUNT];
+	Result *arr;
+	size_t  count;
 } results;
 
+Memcpy *add_memcpy(void) {
+
+	tested_memcpy.arr = realloc(tested_memcpy.arr, (tested_memcpy.count + 1) * sizeof(tested_memcpy.arr[0]));
+	assert(tested_memcpy.arr && "Realloc failed in add_memcpy()");
+
+	Memcpy *m = &tested_memcpy.arr[tested_memcpy.count++];
+	memset(m, 0, sizeof(*m));
+	return m;
+}
+
+void alloc_entries(size_t count) {
+
+	entries.arr   = calloc(count, sizeof(entries.arr[0]));
+	entries.count = count;
+	assert(entries.arr && "Calloc failed in alloc_entries()");
+}
+
 void *aligned_malloc(size_t size, size_t alignment) {
 
 	void *ptr = NULL;
@@ -216,7 +445,223 @@ void fill(
 	} buffer[bufsize] = '\0';
 }
 
-size_t measure_time( 
+/*
+	Scale warmup and run counts down by the same factor
+	once config.runs copies of size would exceed RUN_MAX_BYTES
+*/
+size_t scale_count(size_t count, size_t size) {
+
+	if (size == 0 || (unsigned long long)size * config.runs <= RUN_MAX_BYTES)
+		return count;
+
+	size_t scaled = (size_t)(count * RUN_MAX_BYTES / ((unsigned long long)size * config.runs));
+	if (scaled == 0)
+		scaled = 1;
+
+	return scaled;
+}
+
+int sample_comp(const void *lhs_, const void *rhs_) {
+	const size_t lhs = *(const size_t *)lhs_;
+	const size_t rhs = *(const size_t *)rhs_;
+
+	return (lhs > rhs) - (lhs < rhs);
+}
+
+// Value at percentile p (0 - 100) of a sorted array, nearest rank
+size_t percentile(const size_t *sorted, size_t count, size_t p) {
+
+	assert(count && "Empty sample array in percentile()");
+
+	size_t rank = (p * count + 99) / 100;
+	if (rank == 0)
+		rank = 1;
+
+	return sorted[rank - 1];
+}
+
+const char *const residency_names[RESIDENCY_COUNT]  = { "hot", "cold", "flush", "l1", "l2" };
+const char *const residency_titles[RESIDENCY_COUNT] = { "", ", COLD", ", FLUSH", ", L1", ", L2" };
+
+// RESIDENCY_* measure_time() uses, test_memcpy_set() sets it
+int residency = RESIDENCY_HOT;
+
+// Data cache sizes in bytes, read_cache_sizes() fills them in
+struct {
+	size_t l1d;
+	size_t l2;
+	size_t llc;
+} cache = { 32 << 10, 1 << 20, 32 << 20 };
+
+/*
+	RESIDENCY_COLD buffers, slots of src and dst with the same
+	offset in a page as the ones measure_time() got, used round robin
+	Pages are written once, untouched ones would all map the zero page
+*/
+struct {
+	char   *src;
+	char   *dst;
+	size_t  bytes;
+	size_t  stride;
+	size_t  slots;
+	size_t  next;
+} cold;
+
+void cold_reserve(size_t size) {
+
+	const size_t stride = align_to(size, 4096) + 4096,
+		     slots  = CLAMP(COLD_POOL_LLCS * cache.llc / stride + 1, 2, SIZE_MAX),
+		     bytes  = stride * slots;
+
+	cold.stride = stride;
+	cold.slots  = slots;
+	cold.next   = 0;
+
+	if (bytes <= cold.bytes)
+		return;
+
+	free(cold.src);
+	free(cold.dst);
+	cold.src   = (char *)aligned_malloc(bytes, 4096);
+	cold.dst   = (char *)aligned_malloc(bytes, 4096);
+	cold.bytes = bytes;
+
+	memset(cold.src, 0x5a, bytes);
+	memset(cold.dst, 0xa5, bytes);
+}
+
+void cold_free(void) {
+
+	free(cold.src);
+	free(cold.dst);
+	cold = (typeof(cold)){0};
+}
+
+// RESIDENCY_L2 reads twice L1D of other lines, that leaves nothing of src and dst in it
+struct {
+	char   *buf;
+	size_t  bytes;
+} evict;
+
+void evict_reserve(void) {
+
+	if (evict.bytes >= 2 * cache.l1d)
+		return;
+
+	free(evict.buf);
+	evict.bytes = 2 * cache.l1d;
+	evict.buf   = (char *)aligned_malloc(evict.bytes, 64);
+	memset(evict.buf, 0, evict.bytes);
+}
+
+void evict_free(void) {
+
+	free(evict.buf);
+	evict = (typeof(evict)){0};
+}
+
+// Reads src and writes dst line by line, so both end up in L1D as far as they fit
+void touch(char *dst, const char *src, size_t size) {
+
+	for (size_t i=0; i < size; i += 64) {
+		*(volatile char *)(dst + i) = *(volatile const char *)(src + i);
+	}
+}
+
+/*
+	Gets *dst and *src where the current residency wants them,
+	RESIDENCY_COLD swaps them for the next slot of the pool
+*/
+void prepare_residency(char **dst, char **src, size_t size) {
+
+	switch (residency) {
+		case RESIDENCY_COLD:
+			*src = cold.src + cold.next * cold.stride + (uintptr_t)*src % 4096;
+			*dst = cold.dst + cold.next * cold.stride + (uintptr_t)*dst % 4096;
+			cold.next = (cold.next + 1) % cold.slots;
+			break;
+
+		case RESIDENCY_FLUSH:
+			for (uintptr_t l = (uintptr_t)*src & ~63ul; l < (uintptr_t)*src + size; l += 64)
+				_mm_clflush((const void *)l);
+			for (uintptr_t l = (uintptr_t)*dst & ~63ul; l < (uintptr_t)*dst + size; l += 64)
+				_mm_clflush((const void *)l);
+			_mm_mfence();
+			break;
+
+		case RESIDENCY_L1:
+			touch(*dst, *src, size);
+			break;
+
+		case RESIDENCY_L2:
+			touch(*dst, *src, size);
+			for (size_t i=0; i < evict.bytes; i += 64)
+				(void)*(volatile char *)(evict.buf + i);
+			break;
+	}
+}
+
+// Cells RESIDENCY_L1 and RESIDENCY_L2 can't keep where they want
+int residency_fits(size_t size) {
+
+	switch (residency) {
+		case RESIDENCY_L1: return 2 * size <= cache.l1d;
+		case RESIDENCY_L2: return 2 * size + 2 * cache.l1d <= cache.l2;
+	}
+	return 1;
+}
+
+/*
+	Stats of the first n entries of samples, sorts them
+	Percentiles come from every sample, so the tail stays visible,
+	mean and stddev only from the ones inside the outlier fences
+*/
+Stats sample_stats(size_t n) {
+
+	Stats st = {0};
+
+	qsort(samples, n, sizeof(samples[0]), &sample_comp);
+
+	st.samples = n;
+	st.min     = samples[0];
+	st.median  = percentile(samples, n, 50);
+	st.p90     = percentile(samples, n, 90);
+	st.p99     = percentile(samples, n, 99);
+	st.max     = samples[n - 1];
+
+	// Tukey fences, wide ones, interrupts and migrations land far outside
+	const size_t q1    = percentile(samples, n, 25),
+		     q3    = percentile(samples, n, 75),
+		     iqr   = q3 - q1,
+		     lower = q1 > SAMPLE_FENCE * iqr ? q1 - SAMPLE_FENCE * iqr : 0,
+		     upper = q3 + SAMPLE_FENCE * iqr;
+
+	double sum = 0, sum_sq = 0;
+	size_t kept = 0;
+	for (size_t i=0; i < n; i++) {
+		if (samples[i] < lower || samples[i] > upper)
+			continue;
+
+		sum    += samples[i];
+		sum_sq += (double)samples[i] * samples[i];
+		kept++;
+	}
+
+	st.rejected = n - kept;
+	st.mean     = sum / kept;
+	st.stddev   = kept > 1 ? sqrt((sum_sq - sum * sum / kept) / (kept - 1)) : 0;
+
+	return st;
+}
+
+/*
+	Times batches of calls, one sample per batch, until the 95% confidence
+	interval of the mean is within SAMPLE_CI_TARGET of it
+	or the sample or call budget runs out, see sample_stats()
+	All values are cycles per call
+	Outside RESIDENCY_HOT every batch is a single call after prepare_residency()
+*/
+Stats measure_time( 
 	char  	*dst_txt,
 	char	*src_txt,
 	size_t 	 size,
@@ -226,7 +671,17 @@ size_t measure_time(
 	memcpy_t tested_memcpyi
 
 ) {
-		size_t starttime, endtime, difftime;
+		assert(run_count && "Zero run_count in measure_time()");
+
+		/*
+			run_count calls make at least SAMPLE_MIN_COUNT samples when there
+			are enough of them, up to 4 * run_count calls if the CI is still wide
+		*/
+		const size_t batch       = run_count / SAMPLE_MIN_COUNT && residency == RESIDENCY_HOT ? run_count / SAMPLE_MIN_COUNT : 1,
+			     min_samples = run_count < SAMPLE_MIN_COUNT ? run_count : SAMPLE_MIN_COUNT;
+		      size_t max_samples = 4 * run_count / batch;
+		if (max_samples > SAMPLE_MAX_COUNT)
+			max_samples = SAMPLE_MAX_COUNT;
 
 		utils.cpuid();
 		asm volatile("":::"memory");
@@ -237,24 +692,151 @@ size_t measure_time(
 				src_txt,
 				size);
 		}
-		
-		starttime = utils.rdtsc();
 
-		for(size_t i=0; i < warmup_count; i++) {
-			tested_memcpyi(
-				dst_txt,	
-				src_txt,
-				size);
+		// Welford, only to decide when to stop
+		double mean = 0, m2 = 0;
+		size_t n    = 0;
+
+		for (; n < max_samples; ) {
+
+			char *dst = dst_txt,
+			     *src = src_txt;
+			if (residency != RESIDENCY_HOT)
+				prepare_residency(&dst, &src, size);
+
+			const size_t starttime = timer_begin();
+
+			for(size_t i=0; i < batch; i++) {
+				tested_memcpyi(
+					dst,	
+					src,
+					size);
+			}
+
+			const size_t endtime = timer_end();
+
+			// The timer's own cost, could be a few cycles more than this batch took
+			size_t elapsed = endtime - starttime;
+			elapsed = elapsed > timer_overhead ? elapsed - timer_overhead : 0;
+
+			samples[n++] = elapsed / batch;
+
+			const double delta = samples[n - 1] - mean;
+			mean += delta / n;
+			m2   += delta * (samples[n - 1] - mean);
+
+			if (n < min_samples || n < 2)
+				continue;
+
+			const double half_width = 1.96 * sqrt(m2 / (n - 1) / n);
+			if (half_width <= SAMPLE_CI_TARGET * mean)
+				break;
 		}
-		
-		utils.cpuid();
-		asm volatile("":::"memory");
-		
-		endtime = utils.rdtsc();
 
-		difftime = (endtime - starttime)/run_count;
-		
-		return difftime;
+		return sample_stats(n);
+}
+
+// One call of a sequence measure_sequence() times
+typedef struct {
+	char   *dst;
+	char   *src;
+	size_t  size;
+} Call;
+
+/*
+	Times whole passes over calls, one sample per pass, with the same
+	stop rule as measure_time(). Warmup is config.warmup calls rounded up to
+	whole passes, a pass counts as one of config.runs, up to 4 * SAMPLE_MIN_COUNT
+	of them, and like scale_count() they copy RUN_MAX_BYTES (4 times that timed)
+	at most, but always 2 timed passes. All values are cycles per pass
+*/
+Stats measure_sequence(const Call *calls, size_t count, memcpy_t tested_memcpyi) {
+
+	size_t bytes = 0;
+	for (size_t i=0; i < count; i++)
+		bytes += calls[i].size;
+
+	const size_t budget = bytes ? RUN_MAX_BYTES / bytes : SIZE_MAX;
+
+	size_t warmup = (config.warmup + count - 1) / count,
+	       passes = 4 * SAMPLE_MIN_COUNT;
+	if (warmup > budget)
+		warmup = budget;
+	if (passes > config.runs)
+		passes = config.runs;
+	if (passes > 4 * budget)
+		passes = 4 * budget;
+	if (passes < 2)
+		passes = 2;
+
+	const size_t min_passes = passes < SAMPLE_MIN_COUNT ? passes : SAMPLE_MIN_COUNT;
+
+	utils.cpuid();
+	asm volatile("":::"memory");
+
+	for (size_t w=0; w < warmup; w++) {
+		for (size_t i=0; i < count; i++)
+			tested_memcpyi(calls[i].dst, calls[i].src, calls[i].size);
+	}
+
+	double mean = 0, m2 = 0;
+	size_t n    = 0;
+
+	for (; n < passes; ) {
+
+		const size_t starttime = timer_begin();
+
+		for (size_t i=0; i < count; i++)
+			tested_memcpyi(calls[i].dst, calls[i].src, calls[i].size);
+
+		const size_t endtime = timer_end();
+
+		size_t elapsed = endtime - starttime;
+		samples[n++] = elapsed > timer_overhead ? elapsed - timer_overhead : 0;
+
+		const double delta = samples[n - 1] - mean;
+		mean += delta / n;
+		m2   += delta * (samples[n - 1] - mean);
+
+		if (n < min_passes || n < 2)
+			continue;
+
+		const double half_width = 1.96 * sqrt(m2 / (n - 1) / n);
+		if (half_width <= SAMPLE_CI_TARGET * mean)
+			break;
+	}
+
+	return sample_stats(n);
+}
+
+/*
+	Hardware counters over run_count calls, a pass of its own
+	so that the ioctls don't end up in measure_time() samples
+	Counts are per call, parmemcpy workers aren't counted
+*/
+Pmu count_events(
+	char  	*dst_txt,
+	char	*src_txt,
+	size_t 	 size,
+	size_t 	 run_count,
+	memcpy_t tested_memcpyi,
+	double	*per_call
+) {
+	utils.pmu_start();
+
+	for(size_t i=0; i < run_count; i++) {
+		tested_memcpyi(
+			dst_txt,	
+			src_txt,
+			size);
+	}
+
+	Pmu pmu = utils.pmu_stop();
+
+	for (size_t i=0; i < PMU_COUNT; i++)
+		per_call[i] = (double)pmu.value[i] / run_count;
+
+	return pmu;
 }
 
 void test_memcpy_set(int align){
@@ -262,21 +844,34 @@ void test_memcpy_set(int align){
 	assert( (align == 64 || align == 8)
 		&& "Incorrect align value in test_memcpy_set()");		
 	
-	size_t  marr = ARRAY_SIZE(tested_memcpy.arr),
-		tarr = ARRAY_SIZE(entries.arr),
-		rarr = ARRAY_SIZE(results.arr);
+	size_t  marr = tested_memcpy.count,
+		tarr = entries.count,
+		rarr = marr * tarr;
 	
-	assert(marr == MEMCPY_COUNT    && "tested_memcpy.arr of incorrect size in test_memcpy_set()");
-	assert(tarr == TEST_COUNT      && "entries.arr of incorrect size in test_memcpy_set()");
-	assert(rarr == FULL_TEST_COUNT && "results.arr of incorrect size in test_memcpy_set()");
+	assert(marr && "tested_memcpy.arr empty in test_memcpy_set()");
+	assert(tarr && "entries.arr empty in test_memcpy_set()");
+
+	results.arr = realloc(results.arr, rarr * sizeof(results.arr[0]));
+	assert(results.arr && "Realloc failed in test_memcpy_set()");
 
 	int idx=0, unalignment=0;
 	if (align == 8)
 		unalignment = 71; // making sure that the value is not divisible by 64
 
-	char *src_txt = (char *)aligned_malloc(TEXT_MAX_SIZE + unalignment, align);
-	char *dst_txt = (char *)aligned_malloc(TEXT_MAX_SIZE + unalignment, align);
+	// Buffers only as large as the biggest entry
+	size_t copy_size = 0;
+	for (size_t j=0; j < tarr; j++) {
+		if (entries.arr[j].size * entries.arr[j].reps > copy_size)
+			copy_size = entries.arr[j].size * entries.arr[j].reps;
+	}
+
+	// + 1 for the null terminator written by fill()
+	char *src_buf = (char *)aligned_malloc(copy_size + unalignment + 1, align);
+	char *dst_buf = (char *)aligned_malloc(copy_size + unalignment + 1, align);
 	
+	char *src_txt = src_buf,
+	     *dst_txt = dst_buf;
+
 	if (align == 8) {
 		src_txt = src_txt + unalignment;
 		dst_txt = dst_txt + unalignment;
@@ -288,23 +883,29 @@ void test_memcpy_set(int align){
 	for (unsigned int i=0; i < marr; i++) {
 		for (unsigned int j=0; j < tarr; j++) {
 		
-			assert((uint32_t)idx <= rarr 
+			assert((size_t)idx < rarr 
 				&& "Overflowing results.arr index in test_memcpy_set()");
 	
 			Entry  *ent = &entries.arr[j];
 			Result *res = &results.arr[idx];
 
-			res->size = ent->size * ent->reps;
-			if (res->size > TEXT_MAX_SIZE) {
-			
-				printf("Overflowing results.arr.size in test_memcpy_set()\n");
-				
-				printf("res->size: %zu, TEXT_MAX_SIZE: %d\n",
-				res->size,
-				TEXT_MAX_SIZE);
-				
-				exit(1);
-			}
+			// Outside the sizes the kernel's descriptor allows
+			const Memcpy *m    = &tested_memcpy.arr[i];
+			const size_t  size = ent->size * ent->reps;
+			if (size < m->min_size || (m->max_size && size > m->max_size))
+				continue;
+
+			if (!residency_fits(size))
+				continue;
+
+			if (residency == RESIDENCY_COLD)
+				cold_reserve(size);
+			if (residency == RESIDENCY_L2)
+				evict_reserve();
+
+			res->size      = size;
+			res->align     = align;
+			res->residency = residency;
 
 			fill(
 				src_txt,
@@ -318,17 +919,35 @@ void test_memcpy_set(int align){
 				res->test_name,
 				ent->name);
 		
-			res->difftime = measure_time(
+			res->stats = measure_time(
 				dst_txt,
 				src_txt,
 				res->size,
-				(size_t)(WARMUP_COUNT),
-				(size_t)(RUN_COUNT),
+				scale_count(config.warmup, res->size),
+				scale_count(config.runs,    res->size),
 				tested_memcpy.arr[i].func
 			);
+			res->difftime = res->stats.median;
+
+			// A counted pass can't be cold, counters are only for RESIDENCY_HOT
+			res->events_valid = 0;
+			if (pmu_opened && residency == RESIDENCY_HOT) {
+				res->events_valid = count_events(
+					dst_txt,
+					src_txt,
+					res->size,
+					scale_count(config.runs, res->size),
+					tested_memcpy.arr[i].func,
+					res->events
+				).valid;
+			}
 			idx ++;
 		}
 	}
+	results.count = idx;
+
+	free(src_buf);
+	free(dst_buf);
 }
 
 char *generate_symbols(size_t character_count, char symbol) {
@@ -442,6 +1061,10 @@ void print_column_el(size_t column_len, char *str, const char *align, HSV *hsv)
 			color_reset);
 }
 
+/*
+	By test, then size, then median cycles, which inside one
+	test and size bucket is the same as fastest throughput first
+*/
 int type_comp(const void *lhs_, const void *rhs_) {
 	const Result *lhs = (const Result *)lhs_;
 	const Result *rhs = (const Result *)rhs_;
@@ -553,6 +1176,60 @@ size_t count_digits(size_t num) {
 	return sl;
 }
 
+/*
+	generate_result_table() columns, in order
+	Rank within the test and size bucket and throughput come right after
+	the times, then the counter columns: IPC and
+	one per KB column for every counter from PMU_L1D_MISSES on
+*/
+#define COLUMN_NS		1
+#define COLUMN_RANK		2
+#define COLUMN_BPC		3
+#define COLUMN_GBS		4
+#define COLUMN_PMU		5
+#define COLUMN_PMU_COUNT	((PMU_COUNT) - 1)
+
+// Counter needed by counter column j, IPC needs PMU_CYCLES as well
+size_t pmu_column_counter(size_t j) {
+	return j == 0 ? PMU_INSTRUCTIONS : j + 1;
+}
+
+// Columns without data on this host are left out
+int column_shown(size_t i) {
+
+	if (i == COLUMN_NS || i == COLUMN_GBS)
+		return clock_rate != 0;
+
+	if (i >= COLUMN_PMU && i < COLUMN_PMU + COLUMN_PMU_COUNT) {
+		const size_t j = i - COLUMN_PMU;
+
+		if (j == 0)
+			return (pmu_opened & (1u << PMU_CYCLES)) && (pmu_opened & (1u << PMU_INSTRUCTIONS));
+
+		return !!(pmu_opened & (1u << pmu_column_counter(j)));
+	}
+
+	return 1;
+}
+
+// IPC or events per KB copied, "-" if the counters didn't run for this result
+void pmu_cell(char *cell, const Result *res, size_t j) {
+
+	const uint32_t need = (1u << pmu_column_counter(j)) | (j == 0 ? 1u << PMU_CYCLES : 0);
+	if ((res->events_valid & need) != need || res->size == 0) {
+		strcpy(cell, "-");
+		return;
+	}
+
+	if (j == 0) {
+		const double cycles = res->events[PMU_CYCLES];
+		sprintf(cell, "%.2f", cycles ? res->events[PMU_INSTRUCTIONS] / cycles : 0.0);
+		return;
+	}
+
+	sprintf(cell, "%.2f", res->events[pmu_column_counter(j)] * 1024 / res->size);
+}
+
 void generate_result_table(const char *title__) {
 
 	assert( title__ && "Incorrect title__ value in generate_result_table()");		
@@ -564,18 +1241,29 @@ void generate_result_table(const char *title__) {
 		size_t size;	
 		size_t diff;
 		size_t diff_time;
+		size_t min;
+		size_t p90;
+		size_t p99;
+		size_t worst;
+		size_t stddev;
+		size_t rank;
+		size_t bpc;
+		size_t gbs;
 	} max = {0};	
 
-	assert( sizeof(max)  == sizeof(size_t) * 5 
+	assert( sizeof(max)  == sizeof(size_t) * 13 
 		&& "Incorrect size of struct max in generate_result_table()");
 	
 	size_t  column_count  = sizeof(max)/ sizeof(size_t),
-	        res_size      = ARRAY_SIZE(results.arr);
-	assert( res_size     == FULL_TEST_COUNT 
-		&& "Incorrect size of results.arr in generate_result_table()");	
+	        res_size      = results.count;
 	
 	if (clock_rate == 0) // Remove diff_time column hack
 		column_count--;
+	if (!column_shown(COLUMN_GBS))
+		column_count--;
+
+	for (size_t j=0; j < COLUMN_PMU_COUNT; j++)
+		column_count += column_shown(COLUMN_PMU + j);
 
 	for (uint32_t i=0; i < res_size; i++) {
 	
@@ -583,14 +1271,14 @@ void generate_result_table(const char *title__) {
 		
 		assert(res->memcpy_name && "Res->memcpy_name missing in generate_result_table()");
 		assert(res->test_name	&& "Res->test_name missing in generate_result_table()");
-		assert(res->difftime	&& "Res->difftime missing in generate_result_table()");
-		assert(res->size	&& "Res->size missing in generate_result_table()");
 
 		size_t  test__ = strlen(res->test_name);
 		size_t  mmcp__ = strlen(res->memcpy_name);
 
 		if (res->difftime > max.diff)
 			max.diff  = res->difftime;
+		if (res->stats.max > max.worst)
+			max.worst = res->stats.max;
 		if (res->size	  > max.size) 
 			max.size  = res->size;
 		if (test__ 	  > max.test)
@@ -602,6 +1290,13 @@ void generate_result_table(const char *title__) {
 	max.size = count_digits(max.size);
 	max.diff = count_digits(max.diff);
 
+	// Every other statistic is at most the worst sample
+	max.worst  = count_digits(max.worst);
+	max.min    = max.worst;
+	max.p90    = max.worst;
+	max.p99    = max.worst;
+	max.stddev = max.worst + 2; // one decimal
+
 	if (clock_rate != 0) // Remove diff_time column hack
 		max.diff_time = count_digits(clock_rate) + max.diff;
 
@@ -613,6 +1308,8 @@ void generate_result_table(const char *title__) {
 		column_len = max.size;
 	if (column_len < max.diff)  
 		column_len = max.diff;
+	if (column_len < max.stddev)  
+		column_len = max.stddev;
 	if (clock_rate != 0 && column_len < max.diff_time) // Remove diff_time column hack
 		column_len = max.diff_time;
 
@@ -626,7 +1323,7 @@ void generate_result_table(const char *title__) {
 
 	qsort(
 		results.arr,
-		ARRAY_SIZE(results.arr),
+		res_size,
 		sizeof(results.arr[0]),	
 		&type_comp);	
 
@@ -649,8 +1346,22 @@ void generate_result_table(const char *title__) {
 	
 	char subh_align[] = "left";
 	char *subh[] = {
-		"TIME        (CYCLES):",
-		"TIME        (NS):",
+		"MEDIAN (CYCLES):",
+		"MEDIAN (NS):",
+		"RANK:",
+		"BYTES/CYCLE:",
+		"GB/S:",
+		"IPC:",
+		"L1D MISS/KB:",
+		"LLC MISS/KB:",
+		"DTLB MISS/KB:",
+		"4K ALIAS/KB:",
+		"ST FWD BLOCK/KB:",
+		"MIN:",
+		"P90:",
+		"P99:",
+		"MAX:",
+		"STDDEV:",
 		"SIZE:",
 		"MEMCPY:",
 		"TEST:"
@@ -663,7 +1374,7 @@ void generate_result_table(const char *title__) {
 
 	for (size_t i=0; i < subh_count; i++) {	
 		
-		if (clock_rate == 0 && i == 1)  // Remove diff_time column hack
+		if (!column_shown(i))
 			continue;
 
 		subh_rows[i]= slice(column_len_raw, subh[i]);
@@ -686,7 +1397,7 @@ void generate_result_table(const char *title__) {
 	for (size_t i=0; i < max_rows; i++) {	
 		for (size_t j=0; j < subh_count; j++) {
 
-			if(clock_rate == 0 && j == 1) // Remove diff_time column hack
+			if (!column_shown(j))
 				continue;
 
 			if (i < subh_rows[j].array_len) {
@@ -709,6 +1420,7 @@ void generate_result_table(const char *title__) {
 
 	hsv.v-=20;
 
+	size_t rank = 0;
 	for (uint32_t i=0; i < res_size; i++) {
 	
 		const Result *res = &results.arr[i];
@@ -717,13 +1429,41 @@ void generate_result_table(const char *title__) {
 		     size   [TITLE_MAX_SIZE], 
 		     memcpy [TITLE_MAX_SIZE], 
 		     test   [TITLE_MAX_SIZE],
-		     diff_sc[TITLE_MAX_SIZE];
+		     diff_sc[TITLE_MAX_SIZE],
+		     min    [TITLE_MAX_SIZE],
+		     p90    [TITLE_MAX_SIZE],
+		     p99    [TITLE_MAX_SIZE],
+		     worst  [TITLE_MAX_SIZE],
+		     stddev [TITLE_MAX_SIZE],
+		     rank_s [TITLE_MAX_SIZE],
+		     bpc    [TITLE_MAX_SIZE],
+		     gbs    [TITLE_MAX_SIZE];
+
+		// Sorted fastest first within a bucket, so the rank is the position in it
+		if (i == 0 || res->size != res[-1].size || strcmp(res->test_name, res[-1].test_name) != 0)
+			rank = 1;
+		else
+			rank++;
+
+		sprintf(rank_s, "%zu", rank);
+		if (res->difftime) {
+			sprintf(bpc, "%.2f", (double)res->size / res->difftime);
+			sprintf(gbs, "%.2f", (double)res->size * clock_rate / res->difftime / 1e9);
+		} else {
+			strcpy(bpc, "-");
+			strcpy(gbs, "-");
+		}
 
 		strcpy(memcpy, res->memcpy_name);
 		strcpy(test,   res->test_name);
 
 		sprintf(diff,    "%zu", res->difftime);
 		sprintf(size,    "%zu", res->size);
+		sprintf(min,     "%zu", res->stats.min);
+		sprintf(p90,     "%zu", res->stats.p90);
+		sprintf(p99,     "%zu", res->stats.p99);
+		sprintf(worst,   "%zu", res->stats.max);
+		sprintf(stddev,  "%.1f", res->stats.stddev);
 		if (clock_rate != 0) // Remove diff_time column hack
 			sprintf(diff_sc, "%zu", res->difftime * 1000000000 / clock_rate);
 
@@ -731,6 +1471,23 @@ void generate_result_table(const char *title__) {
 		print_column_el(column_len, diff,    disp_align, &hsv);
 		if (clock_rate != 0) // Remove diff_time column hack
 			print_column_el(column_len, diff_sc, disp_align, &hsv);
+		print_column_el(column_len, rank_s,  disp_align, &hsv);
+		print_column_el(column_len, bpc,     disp_align, &hsv);
+		if (column_shown(COLUMN_GBS))
+			print_column_el(column_len, gbs,     disp_align, &hsv);
+		for (size_t j=0; j < COLUMN_PMU_COUNT; j++) {
+			if (!column_shown(COLUMN_PMU + j))
+				continue;
+
+			char pmu[TITLE_MAX_SIZE];
+			pmu_cell(pmu, res, j);
+			print_column_el(column_len, pmu, disp_align, &hsv);
+		}
+		print_column_el(column_len, min,     disp_align, &hsv);
+		print_column_el(column_len, p90,     disp_align, &hsv);
+		print_column_el(column_len, p99,     disp_align, &hsv);
+		print_column_el(column_len, worst,   disp_align, &hsv);
+		print_column_el(column_len, stddev,  disp_align, &hsv);
 		print_column_el(column_len, size,    disp_align, &hsv);
 		print_column_el(column_len, memcpy,  disp_align, &hsv);
 		print_column_el(column_len, test,    disp_align, &hsv);
@@ -740,58 +1497,2364 @@ void generate_result_table(const char *title__) {
 	
 	for (size_t i=0; i < subh_count; i++) {
 
-		if (clock_rate == 0 && i == 1) // Remove diff_time column hack)
+		if (!column_shown(i))
 			continue;
 
 		free(subh_rows[i].array_pt);
 	}
 }
 
-int main(void) {
+int in_list(const char *name, const char *const list[], size_t list_count) {
 
-	cpu_set_t cpu_set; 
-	size_t cpuset_size = sizeof(cpu_set);
-	
-	int online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (size_t i=0; i < list_count; i++) {
+		if (strcmp(name, list[i]) == 0)
+			return 1;
+	}
+	return 0;
+}
 
-	CPU_ZERO(&cpu_set);		    // clear set and inits struct
-	CPU_SET((online_cpus-1), &cpu_set); // assign last
+/*
+	For every test and size print the given kernels from fastest to slowest,
+	the first one is the winner, top limits how many are shown (0 for all)
+	Results have to be sorted with type_comp first, generate_result_table() does it
+*/
+void print_winners(const char *title, const char *const names[], size_t names_count, size_t top) {
 
-	pid_t pid = getpid();
-	
-	printf("CPU_SET MASK SIZE: %zu BYTES\n",    cpuset_size);
-	printf("CURRENT PROCESS ID: %d\n",          (int)pid);
+	assert(title && "Missing title in print_winners()");
+	assert(names && "Missing names in print_winners()");
 
-	void *pu = dlopen("./perf_utils.so", RTLD_NOW);
-	if (!pu) {
-		printf("dlopen error: %s\n", dlerror());
-		return 1;
-	}
-	
-	utils.cpuid_gcc = dlsym(pu, "cpuid_gcc");
-	if (!utils.cpuid_gcc) {
-		printf("dlopen error: %s\n", dlerror());
-		return 1;
-	}
+	printf("%s\n", title);
 
-	Cpustat cpuid_ret = utils.cpuid_gcc();
-	if (cpuid_ret.has_rdtsc == 0) {
-		printf("No rdtsc\n");
-		return 1;
-	}
+	size_t i=0;
+	while (i < results.count) {
+		
+		const Result *first   = &results.arr[i];
+		size_t        matches = 0;
 
-	if (cpuid_ret.has_invariant_tsc != 0) {
-		if (cpuid_ret.clock_rate != 0){
-			clock_rate = cpuid_ret.clock_rate;
-			printf("Clock rate: %zu, counting time in ns\n", clock_rate);
-		} else {
-			printf("No Clock frequency (leaf 0x15), counting time in clock cycles\n");
+		for (; i < results.count; i++) {
+
+			const Result *res = &results.arr[i];
+			if (res->size != first->size || strcmp(res->test_name, first->test_name) != 0)
+				break;
+
+			// Sorted by difftime, so the first match is the fastest
+			if (!in_list(res->memcpy_name, names, names_count))
+				continue;
+
+			if (top && matches >= top)
+				continue;
+
+			if (matches == 0)
+				printf("  %-16s %12zu  %s %zu",
+					res->test_name,
+					res->size,
+					res->memcpy_name,
+					res->difftime);
+			else
+				printf(" < %s %zu",
+					res->memcpy_name,
+					res->difftime);
+			matches++;
 		}
-	} else {
-		printf("No invariant TSC\n");
+
+		if (matches)
+			puts("");
 	} puts("");
+}
 
-	utils.cpuid = dlsym(pu, "cpuid");
+/*
+	Every size from 1 to SMALL_MAX_SIZE for the given kernels,
+	one row per size and one column of cycles per kernel.
+	Kernels that weren't loaded are left out
+*/
+void test_small_sizes(const char *title, const char *const names[], size_t names_count, int align) {
+
+	assert(title && "Missing title in test_small_sizes()");
+	assert(names && "Missing names in test_small_sizes()");
+	assert( (align == 64 || align == 8)
+		&& "Incorrect align value in test_small_sizes()");		
+
+	int unalignment = 0;
+	if (align == 8)
+		unalignment = 71; // same offset as test_memcpy_set()
+
+	char *src_buf = (char *)aligned_malloc(SMALL_MAX_SIZE + unalignment + 1, align);
+	char *dst_buf = (char *)aligned_malloc(SMALL_MAX_SIZE + unalignment + 1, align);
+	char *src_txt = src_buf + unalignment,
+	     *dst_txt = dst_buf + unalignment;
+
+	fill(src_txt, "as6gn%z#d668", SMALL_MAX_SIZE);
+
+	const Memcpy **tested = malloc(tested_memcpy.count * sizeof(tested[0]));
+	assert(tested && "Malloc failed in test_small_sizes()");
+
+	size_t tested_count = 0,
+	       column_len   = strlen("SIZE:");
+
+	for (size_t i=0; i < tested_memcpy.count; i++) {
+		if (!in_list(tested_memcpy.arr[i].name, names, names_count))
+			continue;
+
+		tested[tested_count++] = &tested_memcpy.arr[i];
+		if (strlen(tested_memcpy.arr[i].name) > column_len)
+			column_len = strlen(tested_memcpy.arr[i].name);
+	}
+	column_len += 2;
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+	char cell[TITLE_MAX_SIZE];
+
+	snprintf(cell, sizeof(cell), "%s", title);
+	print_column_el(column_len * (tested_count + 1), cell, "center", &hsv);
+	puts("");
+
+	strcpy(cell, "SIZE:");
+	print_column_el(column_len, cell, "left", &hsv);
+	for (size_t j=0; j < tested_count; j++) {
+		strcpy(cell, tested[j]->name);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	hsv.v-=20;
+
+	for (size_t size=1; size <= SMALL_MAX_SIZE; size++) {
+
+		sprintf(cell, "%zu", size);
+		print_column_el(column_len, cell, "left", &hsv);
+
+		for (size_t j=0; j < tested_count; j++) {
+
+			if (size < tested[j]->min_size || (tested[j]->max_size && size > tested[j]->max_size)) {
+				strcpy(cell, "-");
+				print_column_el(column_len, cell, "left", &hsv);
+				continue;
+			}
+
+			size_t difftime = measure_time(
+				dst_txt,
+				src_txt,
+				size,
+				config.warmup,
+				config.runs,
+				tested[j]->func
+			).median;
+
+			sprintf(cell, "%zu", difftime);
+			print_column_el(column_len, cell, "left", &hsv);
+		} puts("");
+	}
+
+	free(tested);
+	free(src_buf);
+	free(dst_buf);
+}
+
+const Memcpy *find_memcpy(const char *name) {
+
+	for (size_t i=0; i < tested_memcpy.count; i++) {
+		if (strcmp(tested_memcpy.arr[i].name, name) == 0)
+			return &tested_memcpy.arr[i];
+	}
+	return NULL;
+}
+
+/*
+	pfmemcpy for every prefetch distance and a few copy sizes that miss L2,
+	one row per distance and one column of cycles per size
+*/
+void test_prefetch_distances(void) {
+
+	const Memcpy *pf = find_memcpy("pfmemcpy");
+	if (!pf)
+		return;
+
+	typedef void   (*set_distance_t)(size_t);
+	typedef size_t (*get_distance_t)(void);
+
+	set_distance_t set_distance = (set_distance_t)dlsym(pf->handle, "pfmemcpy_set_distance");
+	get_distance_t get_distance = (get_distance_t)dlsym(pf->handle, "pfmemcpy_get_distance");
+	if (!set_distance || !get_distance) {
+		printf("dlsym error: %s\n", dlerror());
+		return;
+	}
+
+	// 0 prefetches the line that is about to be loaded, it's the baseline
+	const size_t distances[] = { 0, 64, 128, 256, 512, 1024, 2048, 4096 };
+
+	size_t sizes[PREFETCH_SIZE_COUNT],
+	       max_size = 0;
+	for (size_t i=0, size = TEXT_MAX_SIZE * 2; i < PREFETCH_SIZE_COUNT; i++, size *= 4) {
+		sizes[i] = size;
+		max_size = size;
+	}
+	assert(max_size <= COPY_MAX_SIZE && "PREFETCH_SIZE_COUNT too big in test_prefetch_distances()");
+
+	char *src_txt = (char *)aligned_malloc(max_size + 1, 64);
+	char *dst_txt = (char *)aligned_malloc(max_size + 1, 64);
+	fill(src_txt, "as6gn%z#d668", max_size);
+
+	const size_t default_distance = get_distance();
+	const size_t column_len       = count_digits(max_size) + 8;
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+	char cell[TITLE_MAX_SIZE];
+
+	snprintf(cell, sizeof(cell), "PREFETCH DISTANCE, DEFAULT %zu", default_distance);
+	print_column_el(column_len * (PREFETCH_SIZE_COUNT + 1), cell, "center", &hsv);
+	puts("");
+
+	strcpy(cell, "DISTANCE:");
+	print_column_el(column_len, cell, "left", &hsv);
+	for (size_t j=0; j < PREFETCH_SIZE_COUNT; j++) {
+		sprintf(cell, "%zu", sizes[j]);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	hsv.v-=20;
+
+	for (size_t i=0; i < ARRAY_SIZE(distances); i++) {
+
+		set_distance(distances[i]);
+
+		sprintf(cell, "%zu", distances[i]);
+		print_column_el(column_len, cell, "left", &hsv);
+
+		for (size_t j=0; j < PREFETCH_SIZE_COUNT; j++) {
+			size_t difftime = measure_time(
+				dst_txt,
+				src_txt,
+				sizes[j],
+				scale_count(config.warmup, sizes[j]),
+				scale_count(config.runs,    sizes[j]),
+				pf->func
+			).median;
+
+			sprintf(cell, "%zu", difftime);
+			print_column_el(column_len, cell, "left", &hsv);
+		} puts("");
+	}
+
+	set_distance(default_distance);
+
+	free(src_txt);
+	free(dst_txt);
+}
+
+/*
+	parmemcpy for 1, 2, 4... threads up to the pool size and a few copy sizes
+	past the LLC, one row per thread count and one column of cycles per size.
+	Once memory bandwidth saturates more threads stop helping
+*/
+void test_thread_scaling(void) {
+
+	const Memcpy *par = find_memcpy("parmemcpy");
+	if (!par)
+		return;
+
+	typedef void   (*set_tunable_t)(size_t);
+	typedef size_t (*get_tunable_t)(void);
+
+	set_tunable_t set_threads     = (set_tunable_t)dlsym(par->handle, "parmemcpy_set_threads");
+	get_tunable_t get_threads     = (get_tunable_t)dlsym(par->handle, "parmemcpy_get_threads");
+	set_tunable_t set_threshold   = (set_tunable_t)dlsym(par->handle, "parmemcpy_set_threshold");
+	get_tunable_t get_threshold   = (get_tunable_t)dlsym(par->handle, "parmemcpy_get_threshold");
+	get_tunable_t get_max_threads = (get_tunable_t)dlsym(par->handle, "parmemcpy_get_max_threads");
+	if (!set_threads || !get_threads || !set_threshold || !get_threshold || !get_max_threads) {
+		printf("dlsym error: %s\n", dlerror());
+		return;
+	}
+
+	size_t sizes[THREAD_SIZE_COUNT];
+	for (size_t i=0, size = COPY_MAX_SIZE; i < THREAD_SIZE_COUNT; i++, size /= 4)
+		sizes[THREAD_SIZE_COUNT - 1 - i] = size;
+
+	const size_t max_size = sizes[THREAD_SIZE_COUNT - 1];
+
+	char *src_txt = (char *)aligned_malloc(max_size + 1, 64);
+	char *dst_txt = (char *)aligned_malloc(max_size + 1, 64);
+	fill(src_txt, "as6gn%z#d668", max_size);
+
+	const size_t default_threads   = get_threads(),
+		     default_threshold = get_threshold(),
+		     max_threads       = get_max_threads(),
+		     column_len        = count_digits(max_size) + 8;
+
+	// Every size goes through the pool, 1 thread is the single threaded baseline
+	set_threshold(0);
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+	char cell[TITLE_MAX_SIZE];
+
+	snprintf(cell, sizeof(cell), "PARALLEL COPY, %zu THREADS MAX", max_threads);
+	print_column_el(column_len * (THREAD_SIZE_COUNT + 1), cell, "center", &hsv);
+	puts("");
+
+	strcpy(cell, "THREADS:");
+	print_column_el(column_len, cell, "left", &hsv);
+	for (size_t j=0; j < THREAD_SIZE_COUNT; j++) {
+		sprintf(cell, "%zu", sizes[j]);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	hsv.v-=20;
+
+	// 1, 2, 4... and max_threads itself if it isn't a power of 2
+	size_t counts[64],
+	       count_len = 0;
+	for (size_t threads=1; threads < max_threads && count_len < ARRAY_SIZE(counts) - 1; threads *= 2)
+		counts[count_len++] = threads;
+	counts[count_len++] = max_threads;
+
+	for (size_t i=0; i < count_len; i++) {
+
+		set_threads(counts[i]);
+
+		sprintf(cell, "%zu", counts[i]);
+		print_column_el(column_len, cell, "left", &hsv);
+
+		for (size_t j=0; j < THREAD_SIZE_COUNT; j++) {
+			size_t difftime = measure_time(
+				dst_txt,
+				src_txt,
+				sizes[j],
+				scale_count(config.warmup, sizes[j]),
+				scale_count(config.runs,    sizes[j]),
+				par->func
+			).median;
+
+			sprintf(cell, "%zu", difftime);
+			print_column_el(column_len, cell, "left", &hsv);
+		} puts("");
+	}
+
+	set_threads(default_threads);
+	set_threshold(default_threshold);
+
+	free(src_txt);
+	free(dst_txt);
+}
+
+/*
+	Reads a sysfs list like "0-3,8-11" into set
+	Returns how many entries it set, 0 if the file can't be read
+*/
+size_t read_list(const char *path, cpu_set_t *set) {
+
+	CPU_ZERO(set);
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	char line[4096];
+	if (!fgets(line, sizeof(line), f)) {
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	size_t count = 0;
+	char  *pt    = line;
+	while (isdigit((unsigned char)*pt)) {
+
+		long first = strtol(pt, &pt, 10),
+		     last  = first;
+		if (*pt == '-')
+			last = strtol(pt + 1, &pt, 10);
+
+		for (long i=first; i <= last && i < CPU_SETSIZE; i++) {
+			CPU_SET(i, set);
+			count++;
+		}
+
+		if (*pt == ',')
+			pt++;
+	}
+	return count;
+}
+
+/*
+	Page aligned buffer whose pages can only come from node
+	malloc could hand out pages that already sit on another node,
+	mmap gives a fresh range and mbind decides where it gets faulted in
+*/
+char *node_alloc(size_t size, int node) {
+
+	char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(buf != MAP_FAILED && "Mmap failed in node_alloc()");
+
+	unsigned long mask = 1ul << node;
+	if (syscall(SYS_mbind, buf, size, MPOL_BIND, &mask, NUMA_MAX_NODES + 1, MPOL_MF_STRICT | MPOL_MF_MOVE) != 0)
+		perror("mbind");
+
+	return buf;
+}
+
+/*
+	Bytes per cycle of the given kernel for every source node, destination node
+	and node the calling thread is pinned to, one row per src > dst pair
+	and one column per cpu node. Local copies are the 0 > 0, 1 > 1... rows
+	in the matching column, everything else crosses the interconnect
+*/
+void test_numa_matrix(const char *name) {
+
+	const Memcpy *m = find_memcpy(name);
+	if (!m)
+		return;
+
+	cpu_set_t nodes;
+	const size_t node_count = read_list("/sys/devices/system/node/online", &nodes);
+	if (node_count == 0) {
+		printf("No NUMA topology in sysfs, skipping the %s matrix\n", name);
+		return;
+	}
+
+	int node_ids[NUMA_MAX_NODES];
+	size_t ids_count = 0;
+	for (int i=0; i < NUMA_MAX_NODES; i++) {
+		if (CPU_ISSET(i, &nodes))
+			node_ids[ids_count++] = i;
+	}
+
+	cpu_set_t pinned;
+	if (sched_getaffinity(0, sizeof(pinned), &pinned) == -1) {
+		perror("sched_getaffinity");
+		return;
+	}
+
+	const size_t column_len = strlen("CPU NODE ") + count_digits(NUMA_MAX_NODES) + 4;
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+	char cell[TITLE_MAX_SIZE];
+
+	snprintf(cell, sizeof(cell), "NUMA %s, BYTES PER CYCLE", name);
+	print_column_el(column_len * (ids_count + 1), cell, "center", &hsv);
+	puts("");
+
+	strcpy(cell, "SRC > DST:");
+	print_column_el(column_len, cell, "left", &hsv);
+	for (size_t j=0; j < ids_count; j++) {
+		sprintf(cell, "CPU NODE %d", node_ids[j]);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	hsv.v-=20;
+
+	for (size_t s=0; s < ids_count; s++) {
+		for (size_t d=0; d < ids_count; d++) {
+
+			char *src_txt = node_alloc(NUMA_COPY_SIZE + 1, node_ids[s]);
+			char *dst_txt = node_alloc(NUMA_COPY_SIZE + 1, node_ids[d]);
+
+			// Fault every page in on its node before anything gets timed
+			fill(src_txt, "as6gn%z#d668", NUMA_COPY_SIZE);
+			memset(dst_txt, 0, NUMA_COPY_SIZE + 1);
+
+			sprintf(cell, "%d > %d", node_ids[s], node_ids[d]);
+			print_column_el(column_len, cell, "left", &hsv);
+
+			for (size_t c=0; c < ids_count; c++) {
+
+				char path[TITLE_MAX_SIZE];
+				snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node_ids[c]);
+
+				cpu_set_t node_cpus;
+				if (read_list(path, &node_cpus) == 0 ||
+				    sched_setaffinity(0, sizeof(node_cpus), &node_cpus) == -1) {
+					strcpy(cell, "-");
+					print_column_el(column_len, cell, "left", &hsv);
+					continue;
+				}
+
+				size_t difftime = measure_time(
+					dst_txt,
+					src_txt,
+					NUMA_COPY_SIZE,
+					scale_count(config.warmup, NUMA_COPY_SIZE),
+					scale_count(config.runs,    NUMA_COPY_SIZE),
+					m->func
+				).median;
+
+				sprintf(cell, "%.2f", difftime ? (double)NUMA_COPY_SIZE / difftime : 0.0);
+				print_column_el(column_len, cell, "left", &hsv);
+			} puts("");
+
+			munmap(src_txt, NUMA_COPY_SIZE + 1);
+			munmap(dst_txt, NUMA_COPY_SIZE + 1);
+		}
+	}
+
+	if (sched_setaffinity(0, sizeof(pinned), &pinned) == -1)
+		perror("sched_setaffinity");
+}
+
+// --format=csv|json, results are written to export.file as well as printed
+typedef enum {
+	FORMAT_NONE,
+	FORMAT_CSV,
+	FORMAT_JSON
+} Format;
+
+struct {
+	Format  format;
+	FILE   *file;
+	size_t  rows;	// written so far, JSON needs commas between them
+} export;
+
+const char *const pmu_names[PMU_COUNT] = {
+	"cycles",
+	"instructions",
+	"l1d_misses",
+	"llc_misses",
+	"dtlb_misses",
+	"aliasing_4k",
+	"store_forward_blocks"
+};
+
+// First line of path without the newline, "unknown" if it can't be read
+void read_line(const char *path, char *line, size_t line_size) {
+
+	snprintf(line, line_size, "unknown");
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return;
+
+	if (fgets(line, line_size, f))
+		line[strcspn(line, "\n")] = '\0';
+
+	fclose(f);
+}
+
+// Value of the first "key : value" line in /proc/cpuinfo
+void cpuinfo_value(const char *key, char *value, size_t value_size) {
+
+	snprintf(value, value_size, "unknown");
+
+	FILE *f = fopen("/proc/cpuinfo", "r");
+	if (!f)
+		return;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, key, strlen(key)) != 0)
+			continue;
+
+		const char *colon = strchr(line, ':');
+		if (!colon)
+			continue;
+
+		colon++;
+		while (*colon == ' ')
+			colon++;
+
+		snprintf(value, value_size, "%s", colon);
+		value[strcspn(value, "\n")] = '\0';
+		break;
+	}
+	fclose(f);
+}
+
+// JSON string with quotes, only " and \ and control characters need escaping
+void json_string(FILE *f, const char *str) {
+
+	fputc('"', f);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(f, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(f, "\\u%04x", (unsigned char)*str);
+		else
+			fputc(*str, f);
+	}
+	fputc('"', f);
+}
+
+/*
+	Opens path and writes the run metadata,
+	CSV gets it as "# key: value" comment lines above the header
+*/
+int export_open(const char *path, Format format, const Cpustat *cpustat) {
+
+	export.file = fopen(path, "w");
+	if (!export.file) {
+		perror(path);
+		return 1;
+	}
+	export.format = format;
+	export.rows   = 0;
+
+	struct utsname uts;
+	if (uname(&uts) != 0)
+		strcpy(uts.release, "unknown");
+
+	const int cpu = sched_getcpu();
+
+	char model[TITLE_MAX_SIZE], governor[TITLE_MAX_SIZE],
+	     flags[TITLE_MAX_SIZE], path_buf[TITLE_MAX_SIZE], timestamp[64];
+
+	cpuinfo_value("model name", model, sizeof(model));
+	read_line(BUILD_FLAGS_PATH, flags, sizeof(flags));
+
+	snprintf(path_buf, sizeof(path_buf), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+	read_line(path_buf, governor, sizeof(governor));
+
+	const time_t now = time(NULL);
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	const struct {
+		const char *key;
+		const char *value;
+	} text[] = {
+		{ "cpu_model",      model       },
+		{ "build_flags",    flags       },
+		{ "kernel",         uts.release },
+		{ "governor",       governor    },
+		{ "timestamp",      timestamp   }
+	};
+
+	const struct {
+		const char *key;
+		double      value;
+	} numbers[] = {
+		{ "affinity_cpu",      cpu                         },
+		{ "warmup_count",      config.warmup               },
+		{ "run_count",         config.runs                 },
+		{ "clock_rate",        cpustat->clock_rate         },
+		{ "clock_source",      cpustat->clock_source       },
+		{ "clock_ppm",         cpustat->clock_ppm          },
+		{ "max_leaf",          cpustat->max_leaf           },
+		{ "has_rdtsc",         !!cpustat->has_rdtsc        },
+		{ "has_rdtscp",        !!cpustat->has_rdtscp       },
+		{ "has_invariant_tsc", !!cpustat->has_invariant_tsc },
+		{ "features",          cpustat->features           },
+		{ "timer_overhead",    timer_overhead              },
+		{ "pmu_opened",        pmu_opened                  }
+	};
+
+	if (format == FORMAT_CSV) {
+		for (size_t i=0; i < ARRAY_SIZE(text); i++)
+			fprintf(export.file, "# %s: %s\n", text[i].key, text[i].value);
+		for (size_t i=0; i < ARRAY_SIZE(numbers); i++)
+			fprintf(export.file, "# %s: %.17g\n", numbers[i].key, numbers[i].value);
+
+		// --replay and --offsets write export_replay() and export_offset() rows instead
+		if (config.replay || config.random_count) {
+			fprintf(export.file, "memcpy,workload,calls,bytes,median,min,p90,p99,max,mean,stddev,samples,rejected,ns_per_call,ns_per_byte\n");
+			return 0;
+		}
+		if (config.offset_size_count) {
+			fprintf(export.file, "memcpy,size,src_offset,dst_offset,median,min,p90,p99,max,mean,stddev,samples,rejected,bytes_per_cycle\n");
+			return 0;
+		}
+
+		fprintf(export.file, "align,test,memcpy,size,median,min,p90,p99,max,mean,stddev,samples,rejected,bytes_per_cycle");
+		for (size_t i=0; i < PMU_COUNT; i++)
+			fprintf(export.file, ",%s", pmu_names[i]);
+		fprintf(export.file, ",residency\n");
+
+		return 0;
+	}
+
+	fprintf(export.file, "{\n\t\"metadata\": {\n");
+	for (size_t i=0; i < ARRAY_SIZE(text); i++) {
+		fprintf(export.file, "\t\t\"%s\": ", text[i].key);
+		json_string(export.file, text[i].value);
+		fprintf(export.file, ",\n");
+	}
+	for (size_t i=0; i < ARRAY_SIZE(numbers); i++)
+		fprintf(export.file, "\t\t\"%s\": %.17g%s\n",
+			numbers[i].key,
+			numbers[i].value,
+			i + 1 < ARRAY_SIZE(numbers) ? "," : "");
+	fprintf(export.file, "\t},\n\t\"results\": [");
+
+	return 0;
+}
+
+/*
+	Every row of results.arr, call it after each test_memcpy_set()
+	Counters that didn't run are empty in CSV and null in JSON
+*/
+void export_results(void) {
+
+	if (export.format == FORMAT_NONE)
+		return;
+
+	for (size_t i=0; i < results.count; i++) {
+
+		const Result *res = &results.arr[i];
+		const Stats  *st  = &res->stats;
+		const double  bpc = res->difftime ? (double)res->size / res->difftime : 0;
+
+		if (export.format == FORMAT_CSV) {
+			fprintf(export.file, "%d,\"%s\",%s,%zu,%zu,%zu,%zu,%zu,%zu,%.2f,%.2f,%zu,%zu,%.4f",
+				res->align, res->test_name, res->memcpy_name, res->size,
+				st->median, st->min, st->p90, st->p99, st->max,
+				st->mean, st->stddev, st->samples, st->rejected, bpc);
+
+			for (size_t k=0; k < PMU_COUNT; k++) {
+				if (res->events_valid & (1u << k))
+					fprintf(export.file, ",%.2f", res->events[k]);
+				else
+					fprintf(export.file, ",");
+			}
+			fprintf(export.file, ",%s\n", residency_names[res->residency]);
+			continue;
+		}
+
+		fprintf(export.file, "%s\n\t\t{ \"align\": %d, \"test\": ", export.rows ? "," : "", res->align);
+		json_string(export.file, res->test_name);
+		fprintf(export.file, ", \"memcpy\": ");
+		json_string(export.file, res->memcpy_name);
+		fprintf(export.file, ", \"size\": %zu, \"median\": %zu, \"min\": %zu, \"p90\": %zu, \"p99\": %zu, \"max\": %zu"
+				     ", \"mean\": %.2f, \"stddev\": %.2f, \"samples\": %zu, \"rejected\": %zu, \"bytes_per_cycle\": %.4f",
+			res->size, st->median, st->min, st->p90, st->p99, st->max,
+			st->mean, st->stddev, st->samples, st->rejected, bpc);
+
+		for (size_t k=0; k < PMU_COUNT; k++) {
+			if (res->events_valid & (1u << k))
+				fprintf(export.file, ", \"%s\": %.2f", pmu_names[k], res->events[k]);
+			else
+				fprintf(export.file, ", \"%s\": null", pmu_names[k]);
+		}
+		fprintf(export.file, ", \"residency\": \"%s\" }", residency_names[res->residency]);
+
+		export.rows++;
+	}
+}
+
+// One cell of test_offset_matrix()
+void export_offset(const char *name, size_t size, size_t src_offset, size_t dst_offset, const Stats *st) {
+
+	if (export.format == FORMAT_NONE)
+		return;
+
+	const double bpc = st->median ? (double)size / st->median : 0;
+
+	if (export.format == FORMAT_CSV) {
+		fprintf(export.file, "%s,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.2f,%.2f,%zu,%zu,%.4f\n",
+			name, size, src_offset, dst_offset,
+			st->median, st->min, st->p90, st->p99, st->max,
+			st->mean, st->stddev, st->samples, st->rejected, bpc);
+		return;
+	}
+
+	fprintf(export.file, "%s\n\t\t{ \"memcpy\": ", export.rows ? "," : "");
+	json_string(export.file, name);
+	fprintf(export.file, ", \"size\": %zu, \"src_offset\": %zu, \"dst_offset\": %zu"
+			     ", \"median\": %zu, \"min\": %zu, \"p90\": %zu, \"p99\": %zu, \"max\": %zu"
+			     ", \"mean\": %.2f, \"stddev\": %.2f, \"samples\": %zu, \"rejected\": %zu, \"bytes_per_cycle\": %.4f }",
+		size, src_offset, dst_offset,
+		st->median, st->min, st->p90, st->p99, st->max,
+		st->mean, st->stddev, st->samples, st->rejected, bpc);
+
+	export.rows++;
+}
+
+// One kernel of test_replay() or test_random_sizes(), Stats are cycles per pass over every call
+void export_replay(const char *name, const char *workload, size_t calls, size_t bytes, const Stats *st) {
+
+	if (export.format == FORMAT_NONE)
+		return;
+
+	const double ns = clock_rate ? (double)st->median * 1e9 / clock_rate : 0;
+
+	if (export.format == FORMAT_CSV) {
+		fprintf(export.file, "%s,\"%s\",%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.2f,%.2f,%zu,%zu,%.4f,%.6f\n",
+			name, workload, calls, bytes,
+			st->median, st->min, st->p90, st->p99, st->max,
+			st->mean, st->stddev, st->samples, st->rejected,
+			ns / calls, bytes ? ns / bytes : 0);
+		return;
+	}
+
+	fprintf(export.file, "%s\n\t\t{ \"memcpy\": ", export.rows ? "," : "");
+	json_string(export.file, name);
+	fprintf(export.file, ", \"workload\": ");
+	json_string(export.file, workload);
+	fprintf(export.file, ", \"calls\": %zu, \"bytes\": %zu"
+			     ", \"median\": %zu, \"min\": %zu, \"p90\": %zu, \"p99\": %zu, \"max\": %zu"
+			     ", \"mean\": %.2f, \"stddev\": %.2f, \"samples\": %zu, \"rejected\": %zu"
+			     ", \"ns_per_call\": %.4f, \"ns_per_byte\": %.6f }",
+		calls, bytes,
+		st->median, st->min, st->p90, st->p99, st->max,
+		st->mean, st->stddev, st->samples, st->rejected,
+		ns / calls, bytes ? ns / bytes : 0);
+
+	export.rows++;
+}
+
+void export_close(void) {
+
+	if (export.format == FORMAT_NONE)
+		return;
+
+	if (export.format == FORMAT_JSON)
+		fprintf(export.file, "\n\t]\n}\n");
+
+	fclose(export.file);
+}
+
+/*
+	Median cycles of one kernel for every src offset (rows) and dst offset
+	(columns) from a 64 byte aligned base, as a heatmap with background colors,
+	green for the fastest pair through red for the slowest
+*/
+void test_offset_matrix(const Memcpy *m, size_t size) {
+
+	if (size < m->min_size || (m->max_size && size > m->max_size))
+		return;
+
+	char *src_buf = (char *)aligned_malloc(size + OFFSET_COUNT + 1, 64);
+	char *dst_buf = (char *)aligned_malloc(size + OFFSET_COUNT + 1, 64);
+
+	fill(src_buf, "as6gn%z#d668", size + OFFSET_COUNT);
+
+	static size_t median[OFFSET_COUNT][OFFSET_COUNT];
+	size_t fastest = SIZE_MAX, slowest = 0;
+
+	for (size_t s=0; s < OFFSET_COUNT; s++) {
+		for (size_t d=0; d < OFFSET_COUNT; d++) {
+
+			const Stats st = measure_time(
+				dst_buf + d,
+				src_buf + s,
+				size,
+				scale_count(config.warmup, size),
+				scale_count(config.runs,   size),
+				m->func
+			);
+			export_offset(m->name, size, s, d, &st);
+
+			median[s][d] = st.median;
+			if (st.median < fastest)
+				fastest = st.median;
+			if (st.median > slowest)
+				slowest = st.median;
+		}
+	}
+
+	printf("OFFSETS %s, %zu BYTES, CYCLES FROM %zu (GREEN) TO %zu (RED)\n", m->name, size, fastest, slowest);
+
+	printf("%-8s", "SRC\\DST");
+	for (size_t d=0; d < OFFSET_COUNT; d += 8)
+		printf("%-16zu", d);
+	puts("");
+
+	for (size_t s=0; s < OFFSET_COUNT; s++) {
+
+		printf("%-8zu", s);
+		for (size_t d=0; d < OFFSET_COUNT; d++) {
+
+			const double scaled = slowest > fastest ? (double)(median[s][d] - fastest) / (slowest - fastest) : 0;
+
+			HSV hsv = {.h = (int)lround(120 * (1 - scaled)), .s = 100, .v = 100};
+			RGB rgb = hsv_to_rgb(hsv);
+
+			printf("\033[48;2;%d;%d;%dm  ", rgb.r, rgb.g, rgb.b);
+		}
+		printf("\033[49m\n");
+	} puts("");
+
+	free(src_buf);
+	free(dst_buf);
+}
+
+/*
+	Whole number, nothing after it, for --warmup, --runs, --cpu and --align
+	Returns 1 for anything else
+*/
+int parse_count(const char *str, size_t *value) {
+
+	char *end = NULL;
+	errno  = 0;
+	*value = strtoull(str, &end, 10);
+
+	return end == str || *end || errno || *str == '-';
+}
+
+/*
+	Bytes with an optional k, m or g (powers of 1024) suffix
+	Returns 0 for anything else
+*/
+size_t parse_size(const char *str) {
+
+	char  *end  = NULL;
+	size_t size = strtoull(str, &end, 10);
+	if (end == str)
+		return 0;
+
+	switch (tolower(*end)) {
+		case 'k': size <<= 10; end++; break;
+		case 'm': size <<= 20; end++; break;
+		case 'g': size <<= 30; end++; break;
+	}
+
+	return *end ? 0 : size;
+}
+
+// parse_size() that tells a 0 from garbage, returns 1 for garbage
+int replay_size(const char *str, size_t *size) {
+
+	*size = parse_size(str);
+	return *size == 0 && strcmp(str, "0") != 0;
+}
+
+// xorshift64, starts from RNG_SEED
+uint64_t rng_next(uint64_t *state) {
+
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// Sizes from lo to hi, every one as likely, weight relative to the other buckets
+typedef struct {
+	size_t lo;
+	size_t hi;
+	double weight;
+} ReplayBucket;
+
+/*
+	--replay=fleet, a heavy tailed model after the fleet wide memcpy
+	size profiles Google published: most calls copy less than 128 bytes,
+	a few percent reach kilobytes and a thin tail goes up to a megabyte
+	It has their shape, not their data
+*/
+const ReplayBucket fleet_model[] = {
+	{ 0,      8,       12   },
+	{ 9,      16,      14   },
+	{ 17,     32,      20   },
+	{ 33,     64,      18   },
+	{ 65,     128,     12   },
+	{ 129,    256,     8    },
+	{ 257,    512,     6    },
+	{ 513,    1024,    4    },
+	{ 1025,   4096,    4    },
+	{ 4097,   65536,   1.5  },
+	{ 65537,  1 << 20, 0.5  }
+};
+
+// A size and the offsets of src and dst in their page, what test_replay() calls
+typedef struct {
+	size_t size;
+	size_t src_offset;
+	size_t dst_offset;
+} ReplayOp;
+
+struct {
+	ReplayOp *ops;
+	size_t    count;
+	size_t    bytes;
+	size_t    max_size;
+} replay;
+
+ReplayOp *add_replay_op(void) {
+
+	static size_t capacity = 0;
+	if (replay.count == capacity) {
+		capacity   = capacity ? capacity * 2 : REPLAY_CALLS;
+		replay.ops = realloc(replay.ops, capacity * sizeof(replay.ops[0]));
+		assert(replay.ops && "Realloc failed in add_replay_op()");
+	}
+	return &replay.ops[replay.count++];
+}
+
+// REPLAY_CALLS ops out of the buckets, offsets anywhere in a page
+void replay_from_buckets(const ReplayBucket *buckets, size_t bucket_count, uint64_t *rng) {
+
+	double total = 0;
+	for (size_t i=0; i < bucket_count; i++)
+		total += buckets[i].weight;
+
+	for (size_t c=0; c < REPLAY_CALLS; c++) {
+
+		double pick = (double)(rng_next(rng) >> 11) / (1ull << 53) * total;
+		size_t b    = 0;
+		while (b + 1 < bucket_count && pick >= buckets[b].weight)
+			pick -= buckets[b++].weight;
+
+		ReplayOp *op = add_replay_op();
+		op->size       = buckets[b].lo + rng_next(rng) % (buckets[b].hi - buckets[b].lo + 1);
+		op->src_offset = rng_next(rng) % 4096;
+		op->dst_offset = rng_next(rng) % 4096;
+	}
+}
+
+/*
+	"fleet" or a file, one record per line, # for comments, spaces, tabs or commas between fields:
+	  <size> <weight> or <lo>-<hi> <weight>	a histogram, REPLAY_CALLS calls are drawn from it
+	  <size> <src offset> <dst offset>	a trace, replayed in order, offsets are taken mod 4096
+	Sizes take k/m/g suffixes. Returns 1 if it can't be used
+*/
+int load_replay(const char *path) {
+
+	uint64_t rng = RNG_SEED;
+
+	if (strcmp(path, "fleet") == 0) {
+		replay_from_buckets(fleet_model, ARRAY_SIZE(fleet_model), &rng);
+	} else {
+
+		FILE *f = fopen(path, "r");
+		if (!f) {
+			perror(path);
+			return 1;
+		}
+
+		ReplayBucket *buckets = NULL;
+		size_t bucket_count = 0, fields_per_line = 0, line_number = 0;
+		char   line[1024];
+
+		while (fgets(line, sizeof(line), f) && replay.count < REPLAY_MAX_CALLS) {
+
+			line_number++;
+
+			line[strcspn(line, "#\r\n")] = '\0';
+
+			char  *field[4];
+			size_t fields = 0;
+			for (char *t = strtok(line, " \t,"); t && fields < ARRAY_SIZE(field); t = strtok(NULL, " \t,"))
+				field[fields++] = t;
+
+			if (fields == 0)
+				continue;
+
+			// A file is either a histogram or a trace
+			if (!fields_per_line)
+				fields_per_line = fields;
+
+			if (fields != fields_per_line || (fields != 2 && fields != 3)) {
+				printf("Can't parse line %zu of %s\n", line_number, path);
+				free(buckets);
+				fclose(f);
+				return 1;
+			}
+
+			if (fields == 3) {
+				ReplayOp *op = add_replay_op();
+				op->src_offset = strtoull(field[1], NULL, 10) % 4096;
+				op->dst_offset = strtoull(field[2], NULL, 10) % 4096;
+				if (replay_size(field[0], &op->size)) {
+					printf("Can't parse line %zu of %s\n", line_number, path);
+					free(buckets);
+					fclose(f);
+					return 1;
+				}
+				continue;
+			}
+
+			buckets = realloc(buckets, (bucket_count + 1) * sizeof(buckets[0]));
+			assert(buckets && "Realloc failed in load_replay()");
+
+			ReplayBucket *b = &buckets[bucket_count++];
+			char *dash = strchr(field[0], '-');
+			if (dash)
+				*dash = '\0';
+
+			b->weight = atof(field[1]);
+			if (replay_size(field[0], &b->lo) || replay_size(dash ? dash + 1 : field[0], &b->hi) ||
+			    b->hi < b->lo || b->weight < 0) {
+				printf("Can't parse line %zu of %s\n", line_number, path);
+				free(buckets);
+				fclose(f);
+				return 1;
+			}
+		}
+		fclose(f);
+
+		if (bucket_count)
+			replay_from_buckets(buckets, bucket_count, &rng);
+		free(buckets);
+	}
+
+	// A pass copies at most RUN_MAX_BYTES, like one measure_time() cell
+	size_t count = 0;
+	for (; count < replay.count; count++) {
+		if (replay.bytes + replay.ops[count].size > RUN_MAX_BYTES && count)
+			break;
+
+		replay.bytes += replay.ops[count].size;
+		if (replay.ops[count].size > replay.max_size)
+			replay.max_size = replay.ops[count].size;
+	}
+
+	if (count < replay.count)
+		printf("Replaying the first %zu of %zu calls, %llu bytes per pass at most\n", count, replay.count, RUN_MAX_BYTES);
+	replay.count = count;
+
+	if (replay.count == 0) {
+		printf("No calls in replay %s\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+// One kernel in a print_ranked() table
+typedef struct {
+	const Memcpy *m;
+	Stats         st;      // ranks the row
+	Stats         control; // another sequence timed against st, if any
+} RankedRow;
+
+// Writes the cell of a row under header[column]
+typedef void (*ranked_cell_t)(char *cell, size_t cell_size, const RankedRow *row, size_t column);
+
+/*
+	Sorts rows fastest median first and prints them under title, header[0]
+	is the kernel name and the last one the rank, cell_at() fills in the rest
+*/
+void print_ranked(const char *title, const char *const header[], size_t columns,
+	RankedRow *rows, size_t count, ranked_cell_t cell_at) {
+
+	// Insertion sort, fastest first
+	for (size_t i=1; i < count; i++) {
+		for (size_t j=i; j > 0 && rows[j].st.median < rows[j - 1].st.median; j--) {
+			const RankedRow tmp = rows[j];
+			rows[j]     = rows[j - 1];
+			rows[j - 1] = tmp;
+		}
+	}
+
+	char   cell[TITLE_MAX_SIZE];
+	size_t column_len = 0;
+
+	for (size_t j=0; j < columns; j++) {
+		if (strlen(header[j]) > column_len)
+			column_len = strlen(header[j]);
+	}
+	for (size_t i=0; i < count; i++) {
+
+		if (strlen(rows[i].m->name) > column_len)
+			column_len = strlen(rows[i].m->name);
+
+		for (size_t j=1; j + 1 < columns; j++) {
+			cell_at(cell, sizeof(cell), &rows[i], j);
+			if (strlen(cell) > column_len)
+				column_len = strlen(cell);
+		}
+	}
+	column_len += 2;
+
+	// The title spans every column, widen them until it fits
+	if (column_len * columns < strlen(title) + 2)
+		column_len = (strlen(title) + 2 + columns - 1) / columns;
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+
+	snprintf(cell, sizeof(cell), "%s", title);
+	print_column_el(column_len * columns, cell, "center", &hsv);
+	puts("");
+
+	for (size_t j=0; j < columns; j++) {
+		strcpy(cell, header[j]);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	hsv.v-=20;
+
+	for (size_t i=0; i < count; i++) {
+		for (size_t j=0; j < columns; j++) {
+
+			if (j == 0)
+				snprintf(cell, sizeof(cell), "%s", rows[i].m->name);
+			else if (j + 1 == columns)
+				sprintf(cell, "%zu", i + 1);
+			else
+				cell_at(cell, sizeof(cell), &rows[i], j);
+
+			print_column_el(column_len, cell, "left", &hsv);
+		} puts("");
+	} puts("");
+}
+
+// NS/CALL, NS/BYTE, CYCLES/CALL and BYTES/CYCLE of a test_replay() row
+void replay_cell(char *cell, size_t cell_size, const RankedRow *row, size_t column) {
+
+	const double cycles = (double)row->st.median,
+		     ns     = clock_rate ? cycles * 1e9 / clock_rate : 0;
+
+	switch (column) {
+		case 1: clock_rate ? snprintf(cell, cell_size, "%.2f", ns / replay.count) : snprintf(cell, cell_size, "-"); break;
+		case 2: clock_rate && replay.bytes ? snprintf(cell, cell_size, "%.4f", ns / replay.bytes) : snprintf(cell, cell_size, "-"); break;
+		case 3: snprintf(cell, cell_size, "%.1f", cycles / replay.count); break;
+		case 4: snprintf(cell, cell_size, "%.2f", cycles ? replay.bytes / cycles : 0); break;
+	}
+}
+
+/*
+	Every kernel over the same replay.ops, at random pages of a src and a dst pool
+	twice the size of L2 (or 4 times the largest copy), so successive calls don't
+	all hit the same lines. One row per kernel, fastest first,
+	time per call and per byte is the pass median divided by calls and bytes
+*/
+void test_replay(const char *workload) {
+
+	const size_t pool = align_to(
+		2 * cache.l2 > 4 * replay.max_size + 4096 ? 2 * cache.l2 : 4 * replay.max_size + 4096, 4096);
+
+	char *src_pool = (char *)aligned_malloc(pool, 4096);
+	char *dst_pool = (char *)aligned_malloc(pool, 4096);
+	fill(src_pool, "as6gn%z#d668", pool - 1);
+	memset(dst_pool, 0, pool);
+
+	Call *calls = malloc(replay.count * sizeof(calls[0]));
+	assert(calls && "Malloc failed in test_replay()");
+
+	RankedRow *rows  = malloc(tested_memcpy.count * sizeof(rows[0]));
+	size_t     count = 0;
+	assert(rows && "Malloc failed in test_replay()");
+
+	for (size_t i=0; i < tested_memcpy.count; i++) {
+
+		const Memcpy *m = &tested_memcpy.arr[i];
+
+		// Every call has to be one the kernel handles
+		int fits = 1;
+		for (size_t j=0; j < replay.count && fits; j++)
+			fits = replay.ops[j].size >= m->min_size && (!m->max_size || replay.ops[j].size <= m->max_size);
+		if (!fits)
+			continue;
+
+		// Same pages for every kernel, offsets rounded down to the alignment it requires
+		const size_t alignment = m->alignment ? m->alignment : 1;
+		uint64_t     rng       = RNG_SEED;
+		for (size_t j=0; j < replay.count; j++) {
+
+			const ReplayOp *op    = &replay.ops[j];
+			const size_t    pages = (pool - op->size - 4096) / 4096 + 1;
+
+			calls[j].src  = src_pool + rng_next(&rng) % pages * 4096 + op->src_offset / alignment * alignment;
+			calls[j].dst  = dst_pool + rng_next(&rng) % pages * 4096 + op->dst_offset / alignment * alignment;
+			calls[j].size = op->size;
+		}
+
+		rows[count].m  = m;
+		rows[count].st = measure_sequence(calls, replay.count, m->func);
+		export_replay(m->name, workload, replay.count, replay.bytes, &rows[count].st);
+		count++;
+	}
+
+	const char *const header[] = {
+		"MEMCPY:", "NS/CALL:", "NS/BYTE:", "CYCLES/CALL:", "BYTES/CYCLE:", "RANK:"
+	};
+
+	char title[TITLE_MAX_SIZE];
+	snprintf(title, sizeof(title), "REPLAY %s, %zu CALLS, %zu BYTES, %.1f BYTES PER CALL",
+		workload, replay.count, replay.bytes, (double)replay.bytes / replay.count);
+	print_ranked(title, header, ARRAY_SIZE(header), rows, count, &replay_cell);
+
+	free(rows);
+	free(calls);
+	free(src_pool);
+	free(dst_pool);
+}
+
+// RANDOM, FIXED and PENALTY of a test_random_sizes() row, cycles per call
+void random_cell(char *cell, size_t cell_size, const RankedRow *row, size_t column) {
+
+	const double random = (double)row->st.median      / RANDOM_CALLS,
+		     fixed  = (double)row->control.median / RANDOM_CALLS;
+
+	switch (column) {
+		case 1: snprintf(cell, cell_size, "%.1f",  random); break;
+		case 2: snprintf(cell, cell_size, "%.1f",  fixed); break;
+		case 3: snprintf(cell, cell_size, "%+.1f", random - fixed); break;
+	}
+}
+
+/*
+	RANDOM_CALLS calls with sizes from lo to hi and src and dst offsets
+	from 0 to 63, drawn once, against the same calls and offsets at the
+	mean size. measure_time() repeats one size until every branch on it is
+	predicted, here the size dispatch misses like it would on real traffic.
+	Buffers stay hot and both sequences share their offsets, so the
+	difference (PENALTY) is what the random sizes cost. One row per kernel,
+	fastest first, cycles per call
+*/
+void test_random_sizes(size_t lo, size_t hi) {
+
+	char *src_buf = (char *)aligned_malloc(hi + OFFSET_COUNT + 1, 64);
+	char *dst_buf = (char *)aligned_malloc(hi + OFFSET_COUNT + 1, 64);
+	fill(src_buf, "as6gn%z#d668", hi + OFFSET_COUNT);
+
+	ReplayOp ops[RANDOM_CALLS];
+	Call     random[RANDOM_CALLS], fixed[RANDOM_CALLS];
+	size_t   bytes = 0;
+
+	uint64_t rng = RNG_SEED;
+	for (size_t i=0; i < RANDOM_CALLS; i++) {
+		ops[i].size       = lo + rng_next(&rng) % (hi - lo + 1);
+		ops[i].src_offset = rng_next(&rng) % OFFSET_COUNT;
+		ops[i].dst_offset = rng_next(&rng) % OFFSET_COUNT;
+		bytes += ops[i].size;
+	}
+
+	RankedRow *rows  = malloc(tested_memcpy.count * sizeof(rows[0]));
+	size_t     count = 0;
+	assert(rows && "Malloc failed in test_random_sizes()");
+
+	char workload[TITLE_MAX_SIZE];
+
+	for (size_t i=0; i < tested_memcpy.count; i++) {
+
+		const Memcpy *m = &tested_memcpy.arr[i];
+		if (lo < m->min_size || (m->max_size && hi > m->max_size))
+			continue;
+
+		// Offsets rounded down to the alignment the kernel requires
+		const size_t alignment = m->alignment ? m->alignment : 1;
+		for (size_t j=0; j < RANDOM_CALLS; j++) {
+
+			char *dst = dst_buf + ops[j].dst_offset / alignment * alignment,
+			     *src = src_buf + ops[j].src_offset / alignment * alignment;
+
+			random[j] = (Call){ dst, src, ops[j].size };
+			fixed[j]  = (Call){ dst, src, bytes / RANDOM_CALLS };
+		}
+
+		rows[count].m       = m;
+		rows[count].st      = measure_sequence(random, RANDOM_CALLS, m->func);
+		rows[count].control = measure_sequence(fixed,  RANDOM_CALLS, m->func);
+
+		snprintf(workload, sizeof(workload), "random %zu-%zu", lo, hi);
+		export_replay(m->name, workload, RANDOM_CALLS, bytes, &rows[count].st);
+		snprintf(workload, sizeof(workload), "fixed %zu", bytes / RANDOM_CALLS);
+		export_replay(m->name, workload, RANDOM_CALLS, bytes / RANDOM_CALLS * RANDOM_CALLS, &rows[count].control);
+		count++;
+	}
+
+	const char *const header[] = {
+		"MEMCPY:", "RANDOM:", "FIXED:", "PENALTY:", "RANK:"
+	};
+
+	char title[TITLE_MAX_SIZE];
+	snprintf(title, sizeof(title), "RANDOM SIZES %zu TO %zu, FIXED %zu, SAME OFFSETS 0 TO %d, CYCLES PER CALL",
+		lo, hi, bytes / RANDOM_CALLS, OFFSET_COUNT - 1);
+	print_ranked(title, header, ARRAY_SIZE(header), rows, count, &random_cell);
+
+	free(rows);
+	free(src_buf);
+	free(dst_buf);
+}
+
+// --baseline files a cell can be merged from
+#define BASELINE_MAX_RUNS	16
+
+/*
+	A cell of one or more CSVs written by --format=csv, the ones compare_baseline()
+	checks against. Only the columns it needs are kept,
+	merged over every file that has the cell
+*/
+typedef struct {
+	int    align;
+	char   test  [TITLE_MAX_SIZE];
+	char   memcpy[TITLE_MAX_SIZE];
+	size_t size;
+	size_t medians[BASELINE_MAX_RUNS]; // one per file
+	size_t runs;
+	size_t median; // median of medians
+	double sigma;  // standard deviation between runs, from the range of the medians
+	size_t band;   // widest p90 - min of a single file
+	double stddev; // largest of them
+	size_t samples; // fewest of them
+	int    residency; // last column, RESIDENCY_HOT in files from before it
+} BaselineRow;
+
+struct {
+	BaselineRow *arr;
+	size_t       count;
+	double       threshold;   // relative slowdown that counts as a regression
+	size_t       regressions; // over every compare_baseline() so far
+	double       sigma;       // between runs relative to the median, pooled over every cell
+} baseline = { NULL, 0, 0.05, 0, 0 };
+
+/*
+	Chance of a false regression over all the cells of one table,
+	split between them (Bonferroni), see baseline_z()
+*/
+#define BASELINE_ALPHA		0.01
+
+// Medians are whole cycles, a few of them either way is jitter between runs
+#define BASELINE_MIN_CYCLES	4
+
+// Smallest baseline median that counts towards the pooled sigma between runs
+#define BASELINE_POOL_CYCLES	64
+
+// Times a cell that regressed is timed again, it only counts if it regresses every time
+#define BASELINE_RETRIES	2
+
+const BaselineRow *find_baseline_cell(int align, const char *test, const char *name, size_t size, int residency);
+
+/*
+	One --format=csv file into baseline.arr, a cell that's already
+	there from an earlier file gets this file's median added to it
+*/
+int load_baseline_file(const char *path) {
+
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	static size_t capacity = 0;
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+
+		// Metadata and the header
+		if (line[0] == '#' || strncmp(line, "align,", strlen("align,")) == 0)
+			continue;
+
+		BaselineRow cell = {0};
+		size_t      min = 0, p90 = 0;
+
+		// align,"test",memcpy,size,median,min,p90,p99,max,mean,stddev,samples,...
+		const int fields = sscanf(line,
+			"%d,\"%511[^\"]\",%511[^,],%zu,%zu,%zu,%zu,%*u,%*u,%*f,%lf,%zu",
+			&cell.align, cell.test, cell.memcpy, &cell.size,
+			&cell.median, &min, &p90, &cell.stddev, &cell.samples);
+
+		if (fields != 9) {
+			printf("Can't parse baseline line: %s", line);
+			fclose(f);
+			return 1;
+		}
+
+		char *last = strrchr(line, ',') + 1;
+		last[strcspn(last, "\r\n")] = '\0';
+
+		cell.residency = RESIDENCY_HOT;
+		for (int r=0; r < RESIDENCY_COUNT; r++) {
+			if (strcmp(last, residency_names[r]) == 0)
+				cell.residency = r;
+		}
+
+		BaselineRow *row = (BaselineRow *)find_baseline_cell(cell.align, cell.test, cell.memcpy, cell.size, cell.residency);
+		if (!row) {
+			if (baseline.count == capacity) {
+				capacity = capacity ? capacity * 2 : 1024;
+				baseline.arr = realloc(baseline.arr, capacity * sizeof(baseline.arr[0]));
+				assert(baseline.arr && "Realloc failed in load_baseline_file()");
+			}
+
+			row  = &baseline.arr[baseline.count++];
+			*row = cell;
+			row->runs = 0;
+		}
+
+		if (row->runs == BASELINE_MAX_RUNS)
+			continue;
+
+		row->medians[row->runs++] = cell.median;
+		if (p90 - min > row->band && p90 > min)
+			row->band = p90 - min;
+		if (cell.stddev > row->stddev)
+			row->stddev = cell.stddev;
+		if (cell.samples < row->samples)
+			row->samples = cell.samples;
+	}
+	fclose(f);
+
+	return 0;
+}
+
+/*
+	Expected range of n samples of a standard normal, for sigma = range / d2
+	0 and 1 runs have no range
+*/
+const double range_d2[BASELINE_MAX_RUNS + 1] = {
+	0,     0,     1.128, 1.693, 2.059, 2.326, 2.534, 2.704, 2.847,
+	2.970, 3.078, 3.173, 3.258, 3.336, 3.407, 3.472, 3.532
+};
+
+/*
+	--baseline=<file.csv>[,<file.csv>...], more files from the same
+	build give compare_baseline() the spread between runs
+*/
+int load_baseline(char *paths) {
+
+	size_t files = 0;
+	for (char *path = strtok(paths, ","); path; path = strtok(NULL, ",")) {
+		if (load_baseline_file(path))
+			return 1;
+		files++;
+	}
+
+	for (size_t i=0; i < baseline.count; i++) {
+
+		BaselineRow *row = &baseline.arr[i];
+		qsort(row->medians, row->runs, sizeof(row->medians[0]), &sample_comp);
+
+		row->median = percentile(row->medians, row->runs, 50);
+		row->sigma  = row->runs > 1 ? (row->medians[row->runs - 1] - row->medians[0]) / range_d2[row->runs] : 0;
+	}
+
+	/*
+		A few runs give a poor sigma for any one cell, but the cells share the
+		machine, so the median relative one is a floor for each of them
+		Cells of a few cycles are mostly timer granularity, they're left out
+	*/
+	double *relative = malloc((baseline.count + 1) * sizeof(relative[0]));
+	size_t  pooled   = 0;
+	assert(relative && "Malloc failed in load_baseline()");
+
+	for (size_t i=0; i < baseline.count; i++) {
+		const BaselineRow *row = &baseline.arr[i];
+		if (row->runs > 1 && row->median >= BASELINE_POOL_CYCLES)
+			relative[pooled++] = row->sigma / row->median;
+	}
+
+	// Insertion sort, the median of them
+	for (size_t i=1; i < pooled; i++) {
+		for (size_t j=i; j > 0 && relative[j] < relative[j - 1]; j--) {
+			const double tmp = relative[j];
+			relative[j]     = relative[j - 1];
+			relative[j - 1] = tmp;
+		}
+	}
+	baseline.sigma = pooled ? relative[pooled / 2] : 0;
+	free(relative);
+
+	if (files == 1)
+		printf("One baseline run, the noise between runs is unknown, give it several for a stable exit code\n");
+
+	printf("Baseline of %zu run%s: %zu cells, regression threshold %.1f%%, %.1f%% between runs\n",
+		files, files == 1 ? "" : "s", baseline.count, baseline.threshold * 100, baseline.sigma * 100);
+	return 0;
+}
+
+const BaselineRow *find_baseline_cell(int align, const char *test, const char *name, size_t size, int residency) {
+
+	for (size_t i=0; i < baseline.count; i++) {
+		const BaselineRow *row = &baseline.arr[i];
+
+		if (row->align == align && row->size == size && row->residency == residency &&
+		    strcmp(row->memcpy, name) == 0 &&
+		    strcmp(row->test,   test) == 0)
+			return row;
+	}
+	return NULL;
+}
+
+const BaselineRow *find_baseline(const Result *res) {
+	return find_baseline_cell(res->align, res->test_name, res->memcpy_name, res->size, res->residency);
+}
+
+/*
+	Z score that a normal variable passes with a chance of BASELINE_ALPHA / cells,
+	both tails, by bisection on erfc()
+*/
+double baseline_z(size_t cells) {
+
+	const double alpha = BASELINE_ALPHA / (cells ? cells : 1);
+
+	double lo = 0, hi = 40;
+	for (int i=0; i < 100; i++) {
+		const double mid = (lo + hi) / 2;
+		if (erfc(mid / sqrt(2)) > alpha)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return hi;
+}
+
+/*
+	How much slower (or faster, negative) the median in st is than the baseline's,
+	0 for anything inside the threshold, BASELINE_MIN_CYCLES or the noise: the
+	larger of p90 - min of either run's samples and z standard deviations of the
+	difference. That one counts the standard errors of both medians and, with
+	several baseline runs, the spread between runs (placement, frequency),
+	which one run can't show, at least the pooled one of every cell
+*/
+double baseline_delta(const Stats *st, const BaselineRow *base, double z) {
+
+	const double delta = (double)st->median - (double)base->median,
+		     sigma = base->sigma > baseline.sigma * base->median ? base->sigma : baseline.sigma * base->median;
+
+	// A new run is one more draw between runs, on top of the baseline's own median
+	const double error = z * sqrt(
+		st->stddev   * st->stddev   / (st->samples   ? st->samples   : 1) +
+		base->stddev * base->stddev / (base->samples ? base->samples : 1) +
+		sigma        * sigma        * (1 + 1.0 / base->runs));
+
+	const size_t band  = st->p90 - st->min > base->band ? st->p90 - st->min : base->band;
+	const double noise = error > band ? error : band;
+
+	if (fabs(delta) <= baseline.threshold * base->median || fabs(delta) <= noise ||
+	    fabs(delta) <= BASELINE_MIN_CYCLES)
+		return 0;
+
+	return delta;
+}
+
+/*
+	res timed again the way test_memcpy_set() did, same kernel, entry,
+	alignment and residency, for cells that look like regressions
+*/
+Stats retime_result(const Result *res) {
+
+	const Memcpy *m = find_memcpy(res->memcpy_name);
+	assert(m && "Unknown kernel in retime_result()");
+
+	char  pattern[] = "as6gn%z#d668",
+	     *text      = pattern;
+	for (size_t j=0; j < entries.count; j++) {
+		if (strcmp(entries.arr[j].name, res->test_name) == 0 &&
+		    entries.arr[j].size * entries.arr[j].reps == res->size)
+			text = entries.arr[j].text;
+	}
+
+	const int unalignment = res->align == 8 ? 71 : 0; // same as test_memcpy_set()
+
+	char *src_buf = (char *)aligned_malloc(res->size + unalignment + 1, res->align);
+	char *dst_buf = (char *)aligned_malloc(res->size + unalignment + 1, res->align);
+	fill(src_buf + unalignment, text, res->size);
+
+	if (residency == RESIDENCY_COLD)
+		cold_reserve(res->size);
+	if (residency == RESIDENCY_L2)
+		evict_reserve();
+
+	const Stats st = measure_time(
+		dst_buf + unalignment,
+		src_buf + unalignment,
+		res->size,
+		scale_count(config.warmup, res->size),
+		scale_count(config.runs,   res->size),
+		m->func
+	);
+
+	free(src_buf);
+	free(dst_buf);
+	return st;
+}
+
+/*
+	Every cell of results.arr against the baseline, one row per cell that
+	baseline_delta() says changed, a regression only once it regressed
+	BASELINE_RETRIES more times in retime_result(). z is baseline_z()
+	of the cells the table compares. Regressions are red, improvements green.
+	Returns how many regressed
+*/
+size_t compare_baseline(const char *title) {
+
+	if (!baseline.arr)
+		return 0;
+
+	const char *const header[] = {
+		"TEST:", "SIZE:", "MEMCPY:", "BASELINE:", "CURRENT:", "CHANGE:"
+	};
+	size_t column_len = strlen("BASELINE:");
+	for (size_t i=0; i < results.count; i++) {
+		if (strlen(results.arr[i].test_name) > column_len)
+			column_len = strlen(results.arr[i].test_name);
+		if (strlen(results.arr[i].memcpy_name) > column_len)
+			column_len = strlen(results.arr[i].memcpy_name);
+	}
+	column_len += 2;
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+	char cell[TITLE_MAX_SIZE];
+
+	snprintf(cell, sizeof(cell), "%s VS BASELINE", title);
+	print_column_el(column_len * ARRAY_SIZE(header), cell, "center", &hsv);
+	puts("");
+
+	for (size_t j=0; j < ARRAY_SIZE(header); j++) {
+		strcpy(cell, header[j]);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	size_t cells = 0;
+	for (size_t i=0; i < results.count; i++) {
+		const BaselineRow *base = find_baseline(&results.arr[i]);
+		cells += base && base->median;
+	}
+	const double z = baseline_z(cells);
+
+	size_t regressions = 0, compared = 0;
+	for (size_t i=0; i < results.count; i++) {
+
+		const Result      *res  = &results.arr[i];
+		const BaselineRow *base = find_baseline(res);
+		if (!base || base->median == 0)
+			continue;
+
+		compared++;
+
+		// A regression has to show up again when the cell is timed again
+		Stats  st    = res->stats;
+		double delta = baseline_delta(&st, base, z);
+		for (size_t retry=0; delta > 0 && retry < BASELINE_RETRIES; retry++) {
+			st    = retime_result(res);
+			delta = baseline_delta(&st, base, z);
+		}
+
+		if (delta == 0)
+			continue;
+
+		// print_column_el() steps h down by one per cell, start just above the color
+		const int regressed = delta > 0;
+		hsv = (HSV){.h = regressed ? 6 : 126, .s = 100, .v = 100};
+		regressions += regressed;
+
+		const char *const row[] = { res->test_name, NULL, res->memcpy_name, NULL, NULL, NULL };
+		for (size_t j=0; j < ARRAY_SIZE(header); j++) {
+			switch (j) {
+				case 1:  sprintf(cell, "%zu", res->size);    break;
+				case 3:  sprintf(cell, "%zu", base->median); break;
+				case 4:  sprintf(cell, "%zu", st.median); break;
+				case 5:  sprintf(cell, "%+.1f%%", delta * 100 / base->median); break;
+				default: snprintf(cell, sizeof(cell), "%s", row[j]);
+			}
+			print_column_el(column_len, cell, "left", &hsv);
+		} puts("");
+	}
+
+	printf("%zu of %zu cells compared (z %.2f), %zu regressed\n\n", compared, results.count, z, regressions);
+
+	baseline.regressions += regressions;
+	return regressions;
+}
+
+/*
+	SHORT_STR, LONGER_STR, 66666666, both patterns at growing sizes
+	and PATTERN LARGE past the LLC, TEST_COUNT entries
+*/
+void default_tests(void) {
+
+	alloc_entries(TEST_COUNT);
+
+	strcpy(
+		entries.arr[0].name,
+		"SHORT_STR");
+	strcpy(
+		entries.arr[0].text,
+		"This is the text I want you to copy for me");
+	
+	entries.arr[0].size = strlen(entries.arr[0].text);
+	entries.arr[0].reps = 1;	
+
+	strcpy(
+		entries.arr[1].name,
+		"LONGER_STR");
+	strcpy(
+		entries.arr[1].text,
+		"This is an other text I also want you to copy. "
+		"As you can see it's much longer than the previous "
+		"one so that it will be harder to copy for a "
+		"less-performant solution. I think this would be a "
+		"good test for the solution too.");
+
+	entries.arr[1].size = strlen(entries.arr[1].text);
+	entries.arr[1].reps = 1;	
+
+	strcpy(
+		entries.arr[2].name,
+		"66666666");
+	strcpy(
+		entries.arr[2].text,
+		"6");
+
+	entries.arr[2].size = strlen(entries.arr[2].text);
+	entries.arr[2].reps = 8;	
+
+	_Static_assert( PATTERN_COUNT        == 2,
+			"Incorrect pattern count, not equal " STRINGIFY(PATTERN_COUNT));	
+	_Static_assert( PATTERN_REPEAT_COUNT == 4,
+			"Incorrect pattern count, not equal " STRINGIFY(PATTERN_REPEAT_COUNT));	
+
+	uint32_t i = SINGLE_TEST_COUNT;
+	for(; i < (PATTERN_REPEAT_COUNT + SINGLE_TEST_COUNT); i++) {
+	
+		strcpy(
+			entries.arr[i].name,
+			"PATTERN 0");
+		strcpy(
+			entries.arr[i].text,
+			"śg!@$%^63^fb");
+	
+		entries.arr[i].size = strlen(entries.arr[i].text);
+	
+		strcpy(
+			entries.arr[i].text,
+			"as6gn%z#d668");
+
+		entries.arr[i].size = strlen(entries.arr[i].text);
+		entries.arr[i].reps = generate_pattern_reps(&entries.arr[i]);
+	}
+
+	uint32_t newmax = i + PATTERN_REPEAT_COUNT;
+	for(; i < newmax; i++) {
+	
+		strcpy(
+			entries.arr[i].name,
+			"PATTERN 1");
+		
+		strcpy(
+			entries.arr[i].text,
+			"as6gn%z#d668");
+
+		entries.arr[i].size = strlen(entries.arr[i].text);
+		entries.arr[i].reps = generate_pattern_reps(&entries.arr[i]);
+	}
+
+	/*
+		Past TEXT_MAX_SIZE and the LLC, 
+		this is where non-temporal stores should start to win
+	*/
+	newmax = i + LARGE_REPEAT_COUNT;
+	for(size_t target = TEXT_MAX_SIZE * 2; i < newmax; i++, target *= 4) {
+	
+		strcpy(
+			entries.arr[i].name,
+			"PATTERN LARGE");
+		
+		strcpy(
+			entries.arr[i].text,
+			"as6gn%z#d668");
+
+		entries.arr[i].size = strlen(entries.arr[i].text);
+		entries.arr[i].reps = target / entries.arr[i].size;
+	}
+}
+
+// Size after size in the --sizes sweep, one SWEEP entry each, SIZE_MAX once it would overflow
+size_t sweep_next(size_t size) {
+
+	if (config.size_mul)
+		return size > SIZE_MAX / config.size_step ? SIZE_MAX : size * config.size_step;
+
+	return size > SIZE_MAX - config.size_step ? SIZE_MAX : size + config.size_step;
+}
+
+/*
+	Sizes of --sizes=curve, every one from 0 to CURVE_LINEAR_MAX,
+	then config.curve_octave per doubling, rounded to whole bytes
+*/
+size_t curve_size(size_t i) {
+
+	if (i <= CURVE_LINEAR_MAX)
+		return i;
+
+	return (size_t)llround(CURVE_LINEAR_MAX * exp2((double)(i - CURVE_LINEAR_MAX) / config.curve_octave));
+}
+
+/*
+	Size of entry i of --sizes, given the one before it,
+	SIZE_MAX past the end
+*/
+size_t sweep_at(size_t i, size_t previous) {
+
+	const size_t size = config.size_curve ? curve_size(i) : i ? sweep_next(previous) : config.size_min;
+	return size <= config.size_max ? size : SIZE_MAX;
+}
+
+// Entries --sizes makes, SWEEP_MAX_COUNT + 1 for anything past that
+size_t sweep_count(void) {
+
+	size_t count = 0;
+	for (size_t size = sweep_at(0, 0); size != SIZE_MAX && count <= SWEEP_MAX_COUNT; size = sweep_at(count, size))
+		count++;
+	return count;
+}
+
+void sweep_tests(void) {
+
+	const size_t count = sweep_count();
+
+	alloc_entries(count);
+
+	size_t size = 0;
+	for (size_t i=0; i < count; i++) {
+		size = sweep_at(i, size);
+
+		strcpy(
+			entries.arr[i].name,
+			config.size_curve ? "CURVE" : "SWEEP");
+		strcpy(
+			entries.arr[i].text,
+			"as6gn%z#d668");
+
+		entries.arr[i].size = size;
+		entries.arr[i].reps = 1;
+	}
+}
+
+// L1D, L2 and the last level from sysfs, the defaults in cache stay for anything missing
+void read_cache_sizes(void) {
+
+	for (int i=0; ; i++) {
+		char path[256], level[64], type[64], size[64];
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+		read_line(path, level, sizeof(level));
+		if (strcmp(level, "unknown") == 0)
+			break;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+		read_line(path, type, sizeof(type));
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+		read_line(path, size, sizeof(size));
+
+		const size_t bytes = parse_size(size);
+		if (!bytes || strcmp(type, "Instruction") == 0)
+			continue;
+
+		switch (atoi(level)) {
+			case 1:  cache.l1d = bytes; break;
+			case 2:  cache.l2  = bytes; break;
+			default: cache.llc = bytes; break;
+		}
+	}
+}
+
+/*
+	--sizes=<min>:<max>[:<step>], step x<n> multiplies, <n> adds, x2 by default
+	--sizes=curve[:<max>[:<per octave>]], see curve_size()
+*/
+int parse_sizes(const char *str) {
+
+	char arg[TITLE_MAX_SIZE];
+	snprintf(arg, sizeof(arg), "%s", str);
+
+	char *min  = strtok(arg,  ":"),
+	     *max  = strtok(NULL, ":"),
+	     *step = strtok(NULL, ":");
+
+	if (min && strcmp(min, "curve") == 0) {
+		config.size_curve   = 1;
+		config.size_max     = max  ? parse_size(max) : COPY_MAX_SIZE;
+		config.curve_octave = step ? parse_size(step) : CURVE_OCTAVE;
+
+		// More per octave and neighbouring sizes past CURVE_LINEAR_MAX round to the same one
+		return config.size_max <= CURVE_LINEAR_MAX || config.curve_octave == 0 || config.curve_octave > 64 ||
+		       sweep_count() > SWEEP_MAX_COUNT;
+	}
+
+	if (!min || !max)
+		return 1;
+
+	config.size_min  = parse_size(min);
+	config.size_max  = parse_size(max);
+	config.size_step = 2;
+	config.size_mul  = 1;
+
+	if (step) {
+		config.size_mul  = tolower(*step) == 'x';
+		config.size_step = parse_size(step + config.size_mul);
+	}
+
+	if (config.size_min == 0 || config.size_max < config.size_min ||
+	    config.size_step < 1 + (size_t)config.size_mul)
+		return 1;
+
+	if (sweep_count() > SWEEP_MAX_COUNT) {
+		printf("--sizes makes more than %d sizes\n", SWEEP_MAX_COUNT);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+	Splits a comma separated list in place, returns the items
+	in a malloc'd array, *count of them
+*/
+char **split_list(char *str, size_t *count) {
+
+	size_t commas = 1;
+	for (const char *c = str; *c; c++)
+		commas += *c == ',';
+
+	char **items = malloc(commas * sizeof(items[0]));
+	assert(items && "Malloc failed in split_list()");
+
+	*count = 0;
+	for (char *item = strtok(str, ","); item; item = strtok(NULL, ","))
+		items[(*count)++] = item;
+
+	return items;
+}
+
+// --offsets=<size>,<size>...
+int parse_offsets(char *str) {
+
+	size_t count = 0;
+	char **sizes = split_list(str, &count);
+
+	config.offset_sizes      = malloc((count + 1) * sizeof(config.offset_sizes[0]));
+	config.offset_size_count = 0;
+	assert(config.offset_sizes && "Malloc failed in parse_offsets()");
+
+	int invalid = count == 0;
+	for (size_t i=0; i < count && !invalid; i++) {
+		config.offset_sizes[config.offset_size_count] = parse_size(sizes[i]);
+		invalid = config.offset_sizes[config.offset_size_count++] == 0;
+	}
+
+	free(sizes);
+	return invalid;
+}
+
+// --random=<lo>:<hi>,<lo>:<hi>... size buckets, k/m/g suffixes
+int parse_random(const char *str) {
+
+	char  *arg     = strdup(str);
+	size_t count   = 0;
+	assert(arg && "Malloc failed in parse_random()");
+	char **buckets = split_list(arg, &count);
+
+	config.random_count = 0;
+	config.random_lo    = realloc(config.random_lo, (count + 1) * sizeof(config.random_lo[0]));
+	config.random_hi    = realloc(config.random_hi, (count + 1) * sizeof(config.random_hi[0]));
+	assert(config.random_lo && config.random_hi && "Malloc failed in parse_random()");
+
+	int invalid = count == 0;
+	for (size_t i=0; i < count && !invalid; i++) {
+
+		char *colon = strchr(buckets[i], ':');
+		if (!colon) {
+			invalid = 1;
+			break;
+		}
+		*colon = '\0';
+
+		size_t *lo = &config.random_lo[config.random_count],
+		       *hi = &config.random_hi[config.random_count];
+
+		invalid = replay_size(buckets[i], lo) || replay_size(colon + 1, hi) || *hi < *lo || *hi > COPY_MAX_SIZE;
+		config.random_count++;
+	}
+
+	free(buckets);
+	free(arg);
+	return invalid;
+}
+
+// --kernels=<name>,<name>... memcpy is the libc one
+int parse_kernels(char *str) {
+
+	config.kernels = (const char **)split_list(str, &config.kernel_count);
+	return config.kernel_count == 0;
+}
+
+// --align=8,64
+int parse_aligns(char *str) {
+
+	config.align_count = 0;
+	for (char *align = strtok(str, ","); align; align = strtok(NULL, ",")) {
+
+		size_t value = 0;
+		if (parse_count(align, &value) || (value != 8 && value != 64) || config.align_count == ARRAY_SIZE(config.aligns))
+			return 1;
+
+		config.aligns[config.align_count++] = value;
+	}
+
+	return config.align_count == 0;
+}
+
+// --residency=hot,cold,flush,l1,l2
+int parse_residencies(char *str) {
+
+	config.residency_count = 0;
+	for (char *name = strtok(str, ","); name; name = strtok(NULL, ",")) {
+
+		int r = 0;
+		while (r < RESIDENCY_COUNT && strcmp(name, residency_names[r]) != 0)
+			r++;
+
+		if (r == RESIDENCY_COUNT || config.residency_count == ARRAY_SIZE(config.residencies))
+			return 1;
+
+		config.residencies[config.residency_count++] = r;
+	}
+
+	return config.residency_count == 0;
+}
+
+// Kernel is in --kernels or no --kernels given
+int kernel_selected(const char *name) {
+	return config.kernel_count == 0 || in_list(name, config.kernels, config.kernel_count);
+}
+
+/*
+	Bytes per cycle of every kernel, one row per size and one column per kernel,
+	out of results.arr after generate_result_table() sorted it
+*/
+void print_curve(const char *title) {
+
+	size_t column_len = strlen("SIZE:");
+	for (size_t i=0; i < tested_memcpy.count; i++) {
+		if (strlen(tested_memcpy.arr[i].name) > column_len)
+			column_len = strlen(tested_memcpy.arr[i].name);
+	}
+	column_len += 2;
+
+	HSV hsv = {.h = 360, .s = 100, .v = 100};
+	char cell[TITLE_MAX_SIZE];
+
+	snprintf(cell, sizeof(cell), "%s, BYTES PER CYCLE", title);
+	print_column_el(column_len * (tested_memcpy.count + 1), cell, "center", &hsv);
+	puts("");
+
+	strcpy(cell, "SIZE:");
+	print_column_el(column_len, cell, "left", &hsv);
+	for (size_t j=0; j < tested_memcpy.count; j++) {
+		strcpy(cell, tested_memcpy.arr[j].name);
+		print_column_el(column_len, cell, "left", &hsv);
+	} puts("");
+
+	hsv.v-=20;
+
+	// Every size is one run of results, one row per kernel in it
+	size_t i=0;
+	while (i < results.count) {
+
+		const Result *first = &results.arr[i];
+		size_t        end   = i;
+		while (end < results.count && results.arr[end].size == first->size &&
+		       strcmp(results.arr[end].test_name, first->test_name) == 0)
+			end++;
+
+		sprintf(cell, "%zu", first->size);
+		print_column_el(column_len, cell, "left", &hsv);
+
+		for (size_t j=0; j < tested_memcpy.count; j++) {
+
+			strcpy(cell, "-");
+			for (size_t k=i; k < end; k++) {
+				const Result *res = &results.arr[k];
+				if (res->difftime && strcmp(res->memcpy_name, tested_memcpy.arr[j].name) == 0) {
+					sprintf(cell, "%.2f", (double)res->size / res->difftime);
+					break;
+				}
+			}
+			print_column_el(column_len, cell, "left", &hsv);
+		} puts("");
+
+		i = end;
+	} puts("");
+}
+
+// Everything after the result tables, --matrix-only skips it
+void run_studies(void) {
+
+	// Remainder loops against overlapping head/tail copies
+	const char *const tail_handling[] = {
+		"memcpy",
+		"cmemcpy2",
+		"cmemcpy2_ovl",
+		"cmemcpy4",
+		"cmemcpy4_ovl",
+		"cmemcpy5"
+	};
+
+	test_small_sizes("SMALL SIZES, UNALIGNED", tail_handling, ARRAY_SIZE(tail_handling), 8);
+	puts("");
+	test_small_sizes("SMALL SIZES, ALIGNED",   tail_handling, ARRAY_SIZE(tail_handling), 64);
+	puts("");
+
+	test_prefetch_distances();
+	puts("");
+
+	test_thread_scaling();
+	puts("");
+
+	// Single thread, then every thread, then only threads on dst's node
+	test_numa_matrix("memcpy");
+	puts("");
+	test_numa_matrix("parmemcpy");
+	puts("");
+	test_numa_matrix("numamemcpy");
+}
+
+void usage(const char *name) {
+	printf("Usage: %s [options]\n", name);
+	printf("  --kernel-dir directory with the kernel .so files, default ./\n");
+	printf("  --kernels   comma separated kernels to test, memcpy is libc's, default all of them\n");
+	printf("  --sizes     <min>:<max>[:<step>] sweep instead of the default tests, k/m/g suffixes,\n");
+	printf("              step x<n> multiplies and <n> adds, default x2\n");
+	printf("              curve[:<max>[:<per octave>]] every size to %d, then log-spaced,\n", CURVE_LINEAR_MAX);
+	printf("              default max %d and %d per octave\n", COPY_MAX_SIZE, CURVE_OCTAVE);
+	printf("  --align     8 (unaligned), 64 (aligned) or 8,64, default 8,64\n");
+	printf("  --residency hot, cold, flush, l1 and/or l2, where src and dst are before each call,\n");
+	printf("              a result table per mode, default hot\n");
+	printf("  --replay    fleet or a file of <size> <weight> (histogram) or <size> <src offset> <dst offset>\n");
+	printf("              (trace) lines, time per call and per byte of every kernel over it,\n");
+	printf("              instead of the result tables\n");
+	printf("  --random    [=<lo>:<hi>,...] %d calls at random sizes in each bucket and random offsets\n", RANDOM_CALLS);
+	printf("              against the same calls at one size, instead of the result tables,\n");
+	printf("              default %s\n", RANDOM_BUCKETS);
+	printf("  --offsets   <size>,<size>... every src/dst offset pair from 0 to %d for these sizes,\n", OFFSET_COUNT - 1);
+	printf("              as a heatmap per kernel, instead of the result tables\n");
+	printf("  --warmup    calls before timing, default %d\n", WARMUP_COUNT);
+	printf("  --runs      timed calls per cell, default %d\n", RUN_COUNT);
+	printf("  --cpu       cpu to pin the benchmark to, default the last online one\n");
+	printf("  --matrix-only skip the studies after the result tables\n");
+	printf("  --format    also write every result with the run metadata, default none\n");
+	printf("  --output    file for --format, default results.csv or results.json\n");
+	printf("  --baseline  compare against --format=csv files of one or more runs, comma separated,\n");
+	printf("              exit 2 if any cell regressed\n");
+	printf("  --threshold slowdown in percent that counts as a regression, default 5\n");
+}
+
+int main(int argc, char **argv) {
+
+	Format      format   = FORMAT_NONE;
+	const char *output   = NULL;
+	char       *baseline_path = NULL; // load_baseline() splits it
+
+	/*
+		--replay, --random and --offsets replace the result tables, one of them at a time,
+		and the options only those tables use would be ignored with them
+	*/
+	const char *mode   = NULL,
+		   *tables = NULL;
+
+	for (int i=1; i < argc; i++) {
+		int invalid = 0;
+
+		if (strcmp(argv[i], "--format=csv") == 0) {
+			format = FORMAT_CSV;
+		} else if (strcmp(argv[i], "--format=json") == 0) {
+			format = FORMAT_JSON;
+		} else if (strncmp(argv[i], "--output=", strlen("--output=")) == 0) {
+			output = argv[i] + strlen("--output=");
+		} else if (strncmp(argv[i], "--baseline=", strlen("--baseline=")) == 0) {
+			baseline_path = argv[i] + strlen("--baseline=");
+		} else if (strncmp(argv[i], "--threshold=", strlen("--threshold=")) == 0) {
+			char *end = NULL;
+			baseline.threshold = strtod(argv[i] + strlen("--threshold="), &end) / 100;
+			invalid = end == argv[i] + strlen("--threshold=") || *end || baseline.threshold < 0;
+		} else if (strncmp(argv[i], "--kernel-dir=", strlen("--kernel-dir=")) == 0) {
+			config.kernel_dir = argv[i] + strlen("--kernel-dir=");
+		} else if (strncmp(argv[i], "--kernels=", strlen("--kernels=")) == 0) {
+			invalid = parse_kernels(argv[i] + strlen("--kernels="));
+		} else if (strncmp(argv[i], "--sizes=", strlen("--sizes=")) == 0) {
+			invalid = parse_sizes(argv[i] + strlen("--sizes="));
+		} else if (strncmp(argv[i], "--replay=", strlen("--replay=")) == 0) {
+			config.replay = argv[i] + strlen("--replay=");
+		} else if (strcmp(argv[i], "--random") == 0) {
+			invalid = parse_random(RANDOM_BUCKETS);
+		} else if (strncmp(argv[i], "--random=", strlen("--random=")) == 0) {
+			invalid = parse_random(argv[i] + strlen("--random="));
+		} else if (strncmp(argv[i], "--offsets=", strlen("--offsets=")) == 0) {
+			invalid = parse_offsets(argv[i] + strlen("--offsets="));
+		} else if (strncmp(argv[i], "--align=", strlen("--align=")) == 0) {
+			invalid = parse_aligns(argv[i] + strlen("--align="));
+		} else if (strncmp(argv[i], "--residency=", strlen("--residency=")) == 0) {
+			invalid = parse_residencies(argv[i] + strlen("--residency="));
+		} else if (strncmp(argv[i], "--warmup=", strlen("--warmup=")) == 0) {
+			invalid = parse_count(argv[i] + strlen("--warmup="), &config.warmup);
+		} else if (strncmp(argv[i], "--runs=", strlen("--runs=")) == 0) {
+			invalid = parse_count(argv[i] + strlen("--runs="), &config.runs) || config.runs == 0;
+		} else if (strncmp(argv[i], "--cpu=", strlen("--cpu=")) == 0) {
+			size_t cpu = 0;
+			invalid    = parse_count(argv[i] + strlen("--cpu="), &cpu) || cpu > INT_MAX;
+			config.cpu = (int)cpu;
+		} else if (strcmp(argv[i], "--matrix-only") == 0) {
+			config.matrix_only = 1;
+		} else if (strcmp(argv[i], "--help") == 0) {
+			usage(argv[0]);
+			return 0;
+		} else {
+			invalid = 1;
+		}
+
+		if (invalid) {
+			printf("Invalid argument: %s\n\n", argv[i]);
+			usage(argv[0]);
+			return 1;
+		}
+
+		const char *const mode_options[]   = { "--replay=", "--random", "--offsets=" },
+			   *const tables_options[] = { "--baseline=", "--residency=", "--align=", "--sizes=" };
+
+		for (size_t j=0; j < ARRAY_SIZE(mode_options); j++) {
+			if (strncmp(argv[i], mode_options[j], strlen(mode_options[j])) != 0)
+				continue;
+
+			if (mode) {
+				printf("%s and %s are separate modes, run them one at a time\n", mode, argv[i]);
+				return 1;
+			}
+			mode = argv[i];
+		}
+
+		for (size_t j=0; j < ARRAY_SIZE(tables_options); j++) {
+			if (strncmp(argv[i], tables_options[j], strlen(tables_options[j])) == 0 && !tables)
+				tables = argv[i];
+		}
+	}
+
+	if (mode && tables) {
+		printf("%s only applies to the result tables, %s replaces them\n", tables, mode);
+		return 1;
+	}
+
+	if (format != FORMAT_NONE && !output)
+		output = format == FORMAT_CSV ? "results.csv" : "results.json";
+
+	if (baseline_path && load_baseline(baseline_path))
+		return 1;
+
+	cpu_set_t cpu_set; 
+	size_t cpuset_size = sizeof(cpu_set);
+	
+	int online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (config.cpu < 0)
+		config.cpu = online_cpus - 1;	// last by default
+
+	if (config.cpu >= online_cpus) {
+		printf("No cpu %d, %d online\n", config.cpu, online_cpus);
+		return 1;
+	}
+
+	CPU_ZERO(&cpu_set);		    // clear set and inits struct
+	CPU_SET(config.cpu, &cpu_set);
+
+	pid_t pid = getpid();
+	
+	printf("CPU_SET MASK SIZE: %zu BYTES\n",    cpuset_size);
+	printf("CURRENT PROCESS ID: %d\n",          (int)pid);
+
+	void *pu = dlopen("./perf_utils.so", RTLD_NOW);
+	if (!pu) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+	
+	utils.cpuid_gcc = dlsym(pu, "cpuid_gcc");
+	if (!utils.cpuid_gcc) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+
+	Cpustat cpuid_ret = utils.cpuid_gcc();
+	if (cpuid_ret.has_rdtsc == 0) {
+		printf("No rdtsc\n");
+		return 1;
+	}
+
+	if (cpuid_ret.has_invariant_tsc != 0) {
+		if (cpuid_ret.clock_rate != 0){
+			clock_rate = cpuid_ret.clock_rate;
+			printf("Clock rate: %zu, counting time in ns\n", clock_rate);
+		} else {
+			printf("No Clock frequency, counting time in clock cycles\n");
+		}
+	} else {
+		printf("No invariant TSC\n");
+	} puts("");
+
+	utils.cpuid = dlsym(pu, "cpuid");
 	if (!utils.cpuid) {
 		printf("dlopen error: %s\n", dlerror());
 		return 1;
@@ -815,6 +3878,36 @@ int main(void) {
 		return 1;
 	}
 
+	utils.tsc_begin = dlsym(pu, "tsc_begin");
+	if (!utils.tsc_begin) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+
+	utils.tsc_end = dlsym(pu, "tsc_end");
+	if (!utils.tsc_end) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+
+	utils.pmu_open = dlsym(pu, "pmu_open");
+	if (!utils.pmu_open) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+
+	utils.pmu_start = dlsym(pu, "pmu_start");
+	if (!utils.pmu_start) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+
+	utils.pmu_stop = dlsym(pu, "pmu_stop");
+	if (!utils.pmu_stop) {
+		printf("dlopen error: %s\n", dlerror());
+		return 1;
+	}
+
 	if (sched_setaffinity(pid, cpuset_size, &cpu_set) == -1) {
 		perror("sched_setaffinity");
 		return 1;
@@ -825,154 +3918,182 @@ int main(void) {
 		return 1;
 	}
 
-	tested_memcpy.arr[0].func = memcpy;
-	strcpy(	tested_memcpy.arr[0].name,
-		"memcpy");
+	// Calibrated on the cpu the benchmark runs on
+	has_rdtscp     = cpuid_ret.has_rdtscp != 0;
+	timer_overhead = calibrate_timer();
+	printf("Timing with %s, overhead %zu cycles\n",
+		has_rdtscp ? "rdtscp + lfence" : "cpuid + rdtsc (no rdtscp)", timer_overhead);
 
-	// LOAD MEMCOPY IMPLEMENTATIONS
-	const uint64_t mcount = MEMCPY_COUNT - 1;
-	void *f[mcount];
-	const char *mnlist[] = {
-		"cmemcpy",
-		"cmemcpy2",
-		"cmemcpy3",
-		"cmemcpy_al",
-		"cmemcpy_unal"
-	}; 
-	assert(ARRAY_SIZE(mnlist) == mcount);
-	
-	char mlist[mcount][1024];
-
-	for (uint64_t i=0; i < mcount; i++) {
-		snprintf( mlist[i], 
-			  sizeof(mlist[i]),
-			  "./%s.so",
-			  mnlist[i]
-		 );
-		
-		f[i] = dlopen(mlist[i], RTLD_NOW);
-		if (!f[i]) {
-			perror("dlopen");
+	// Counters count the thread that opens them, so after pinning
+	pmu_opened = utils.pmu_open();
+	if (pmu_opened)
+		printf("Hardware counters: 0x%02" PRIx32 " of 0x%02x\n", pmu_opened, (1u << PMU_COUNT) - 1);
+	else
+		printf("No hardware counters (no PMU or perf_event_paranoid), leaving them out\n");
+
+	if (format != FORMAT_NONE && export_open(output, format, &cpuid_ret))
+		return 1;
+
+	read_cache_sizes();
+	printf("Caches: L1D %zuK, L2 %zuK, LLC %zuK\n", cache.l1d >> 10, cache.l2 >> 10, cache.llc >> 10);
+
+	// LOAD MEMCOPY IMPLEMENTATIONS, every kernel in config.kernel_dir the cpu can run
+	Kernel *kernels = NULL;
+	const size_t kcount = discover_kernels(config.kernel_dir, cpuid_ret.features, &kernels);
+
+	for (size_t i=0; i < config.kernel_count; i++) {
+
+		int known = strcmp(config.kernels[i], "memcpy") == 0;
+		for (size_t j=0; j < kcount; j++)
+			known |= strcmp(config.kernels[i], kernels[j].name) == 0;
+
+		if (!known) {
+			printf("No kernel %s in %s for this cpu\n", config.kernels[i], config.kernel_dir);
 			return 1;
 		}
 	}
 
-	tested_memcpy.arr[1].func = dlsym(f[0], mnlist[0]);
-	strcpy( tested_memcpy.arr[1].name,
-		"cmemcpy");
+	if (kernel_selected("memcpy")) {
+		Memcpy *m = add_memcpy();
+		m->func   = memcpy;
+		m->handle = NULL;
+		strcpy(m->name, "memcpy");
+	}
+
+	for (size_t i=0; i < kcount; i++) {
+
+		const Kernel *k = &kernels[i];
+		if (!kernel_selected(k->name))
+			continue;
+
+		Memcpy *m = add_memcpy();
+		m->func     = k->func;
+		m->handle   = k->handle;
+		m->min_size = k->desc.min_size;
+		m->max_size = k->desc.max_size;
+		m->alignment = k->desc.alignment;
+		strcpy(m->name, k->name);
+
+		// Dispatchers tell which kernel they picked for this host
+		char name_fn[1024];
+		snprintf(name_fn, sizeof(name_fn), "%s_name", k->name);
+
+		const char *(*picked)(void) = (const char *(*)(void))dlsym(k->handle, name_fn);
+		if (picked)
+			printf("%s resolves to %s\n", k->name, picked());
+	}
+
+	if (config.replay) {
+		if (load_replay(config.replay))
+			return 1;
 
-	tested_memcpy.arr[2].func = dlsym(f[1], mnlist[1]);
-	strcpy( tested_memcpy.arr[2].name,
-		"cmemcpy2");
+		test_replay(config.replay);
+		export_close();
+		return 0;
+	}
 
-	tested_memcpy.arr[3].func = dlsym(f[2], mnlist[2]);
-	strcpy( tested_memcpy.arr[3].name,
-		"cmemcpy3");
+	if (config.random_count) {
+		for (size_t i=0; i < config.random_count; i++)
+			test_random_sizes(config.random_lo[i], config.random_hi[i]);
+		export_close();
+		return 0;
+	}
 
-	tested_memcpy.arr[4].func = dlsym(f[3], mnlist[3]);
-	strcpy( tested_memcpy.arr[4].name,
-		"cmemcpy_al");
+	if (config.offset_size_count) {
+		for (size_t i=0; i < tested_memcpy.count; i++) {
+			for (size_t j=0; j < config.offset_size_count; j++)
+				test_offset_matrix(&tested_memcpy.arr[i], config.offset_sizes[j]);
+		}
+		export_close();
+		return 0;
+	}
 
-	tested_memcpy.arr[5].func = dlsym(f[4], mnlist[4]);
-	strcpy( tested_memcpy.arr[5].name,
-		"cmemcpy_unal");
+	if (config.size_max)
+		sweep_tests();
+	else
+		default_tests();
 
-	if (ARRAY_SIZE(entries.arr) != TEST_COUNT) {
-		printf("entries.arr not %d elements long\n", TEST_COUNT);
+	if (tested_memcpy.count == 0) {
+		printf("No kernels to test\n");
 		return 1;
 	}
 
-	strcpy(
-		entries.arr[0].name,
-		"SHORT_STR");
-	strcpy(
-		entries.arr[0].text,
-		"This is the text I want you to copy for me");
-	
-	entries.arr[0].size = strlen(entries.arr[0].text);
-	entries.arr[0].reps = 1;	
+	// rep movsb against plain vector loops, for each size class
+	const char *const rep_vs_vec[] = {
+		"repmovsb",
+		"ermsmemcpy",
+		"sse2memcpy_unal",
+		"avx2memcpy_unal",
+		"avx512memcpy_unal"
+	};
 
-	strcpy(
-		entries.arr[1].name,
-		"LONGER_STR");
-	strcpy(
-		entries.arr[1].text,
-		"This is an other text I also want you to copy. "
-		"As you can see it's much longer than the previous "
-		"one so that it will be harder to copy for a "
-		"less-performant solution. I think this would be a "
-		"good test for the solution too.");
+	// Same 16 byte loads, stores with and without a destination alignment prologue
+	const char *const dst_align[] = {
+		"alignmemcpy",
+		"sse2memcpy_unal",
+		"cmemcpy4",
+		"cmemcpy5"
+	};
 
-	entries.arr[1].size = strlen(entries.arr[1].text);
-	entries.arr[1].reps = 1;	
+	// Best unroll/width/store combinations out of the generated family
+	const char **generated       = malloc(tested_memcpy.count * sizeof(generated[0]));
+	size_t       generated_count = 0;
+	assert(generated && "Malloc failed in main()");
 
-	strcpy(
-		entries.arr[2].name,
-		"66666666");
-	strcpy(
-		entries.arr[2].text,
-		"6");
+	for (size_t i=0; i < tested_memcpy.count; i++) {
+		if (strncmp(tested_memcpy.arr[i].name, "genmemcpy_", strlen("genmemcpy_")) == 0)
+			generated[generated_count++] = tested_memcpy.arr[i].name;
+	}
 
-	entries.arr[2].size = strlen(entries.arr[2].text);
-	entries.arr[2].reps = 8;	
+	// Base structs generated, proceeding to test memcpy set, unaligned then aligned data, once per residency
+	for (size_t r=0; r < config.residency_count; r++) {
+		for (size_t a=0; a < config.align_count; a++) {
 
-	size_t 	rarr = ARRAY_SIZE(results.arr);
+			const int   align = config.aligns[a];
+			char        title  [32];
+			char        winners[TITLE_MAX_SIZE];
 
-	_Static_assert( PATTERN_COUNT        == 2,
-			"Incorrect pattern count, not equal " STRINGIFY(PATTERN_COUNT));	
-	_Static_assert( PATTERN_REPEAT_COUNT == 4,
-			"Incorrect pattern count, not equal " STRINGIFY(PATTERN_REPEAT_COUNT));	
+			residency = config.residencies[r];
+			snprintf(title, sizeof(title), "%s%s", align == 8 ? "UNALIGNED" : "ALIGNED", residency_titles[residency]);
 
-	uint32_t i = SINGLE_TEST_COUNT;
-	for(; i < (PATTERN_REPEAT_COUNT + SINGLE_TEST_COUNT); i++) {
-	
-		strcpy(
-			entries.arr[i].name,
-			"PATTERN 0");
-		strcpy(
-			entries.arr[i].text,
-			"śg!@$%^63^fb");
-	
-		entries.arr[i].size = strlen(entries.arr[i].text);
-	
-		strcpy(
-			entries.arr[i].text,
-			"as6gn%z#d668");
+			test_memcpy_set(align); // Correct alignments are 8 and 64
 
-		entries.arr[i].size = strlen(entries.arr[i].text);
-		entries.arr[i].reps = generate_pattern_reps(&entries.arr[i]);
-	}
+			// Print results
+			if (r || a)
+				puts("");
+			generate_result_table(title);
+			export_results();
+			puts("");
 
-	uint32_t newmax = i + PATTERN_REPEAT_COUNT;
-	for(; i < newmax; i++) {
-	
-		strcpy(
-			entries.arr[i].name,
-			"PATTERN 1");
-		
-		strcpy(
-			entries.arr[i].text,
-			"as6gn%z#d668");
+			if (config.size_curve)
+				print_curve(title);
+			compare_baseline(title);
+			puts("");
 
-		entries.arr[i].size = strlen(entries.arr[i].text);
-		entries.arr[i].reps = generate_pattern_reps(&entries.arr[i]);
-	}
-	
-	if (rarr != FULL_TEST_COUNT) {
-		printf("results.arr not %d elements long\n", FULL_TEST_COUNT);
-		return 1;
+			snprintf(winners, sizeof(winners), "REP MOVSB VS VECTOR, %s", title);
+			print_winners(winners, rep_vs_vec, ARRAY_SIZE(rep_vs_vec), 0);
+
+			if (align == 8) {
+				snprintf(winners, sizeof(winners), "DESTINATION ALIGNMENT PROLOGUE, %s", title);
+				print_winners(winners, dst_align, ARRAY_SIZE(dst_align), 0);
+			} else {
+				snprintf(winners, sizeof(winners), "GENERATED VARIANTS, %s, TOP 5", title);
+				print_winners(winners, generated, generated_count, 5);
+			}
+		}
 	}
+	residency = RESIDENCY_HOT;
+	cold_free();
+	evict_free();
+	export_close();
 
-	// Base structs generated, proceeding to test memcpy set 
-	test_memcpy_set(8); // Correct alignments are 8 and 64
-	
-	// Print results
-	generate_result_table("Unaligned");
+	if (!config.matrix_only)
+		run_studies();
 
-	test_memcpy_set(64); // run all the tests again with aligned data
-	
-	puts("");
-	generate_result_table("Aligned"); 
+	if (baseline.regressions) {
+		printf("\n%zu cells regressed against the baseline\n", baseline.regressions);
+		return 2;
+	}
 
 	return 0;
 }